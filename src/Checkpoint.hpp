@@ -0,0 +1,293 @@
+/*
+ * File:   Checkpoint.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef CHECKPOINT_HPP
+#define	CHECKPOINT_HPP
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace spc {
+
+    /**
+     * One completed image as recorded in the checkpoint journal
+     */
+    struct CheckpointRow {
+        std::string path;
+        std::string csv;
+        int gridWidth;
+        int gridHeight;
+        int positive;
+        int total;
+    };
+
+    /**
+     * Lets a long run be resumed after it is killed.
+     *
+     * Every completed image's CSV row is appended to <path>.journal.  Every
+     * interval images the journal is synced and a small state file <path>
+     * holding the run parameters, the length of the journal that is known
+     * good, the totals and the elapsed time is written to a temporary file
+     * and atomically renamed into place.  Resuming reads the state file,
+     * truncates the journal to the committed length and replays it.
+     */
+    class Checkpoint {
+    public:
+
+        Checkpoint() : _journal(NULL), _interval(1000), _sinceCommit(0),
+        _committedBytes(0), _gridX(0), _gridY(0), _threshold(0),
+        _previousSeconds(0.0), _images(0), _totalPositive(0), _total(0) {
+        }
+
+        virtual ~Checkpoint() {
+            if (_journal != NULL) {
+                fclose(_journal);
+            }
+        }
+
+        /**
+         * Opens checkpoint
+         * @param path state file path, journal is path + ".journal"
+         * @param gridX
+         * @param gridY
+         * @param threshold
+         * @param interval number of images between commits
+         * @param resume if true load existing checkpoint, if there is one
+         *        it must have been written with the same gridX, gridY and
+         *        threshold. Otherwise any existing checkpoint is
+         *        overwritten.
+         * @param error set to reason upon failure
+         * @return false upon failure
+         */
+        bool open(const std::string& path, int gridX, int gridY, int threshold,
+                int interval, bool resume, std::string& error) {
+            _statePath = path;
+            _journalPath = path + ".journal";
+            _gridX = gridX;
+            _gridY = gridY;
+            _threshold = threshold;
+            _interval = interval > 0 ? interval : 1;
+
+            if (resume && access(_statePath.c_str(), F_OK) != 0) {
+                // nothing to resume from, start fresh
+                resume = false;
+            }
+            if (resume) {
+                if (!loadState(error) || !loadJournal(error)) {
+                    return false;
+                }
+            } else {
+                if (truncate(_journalPath.c_str(), 0) != 0 && errno != ENOENT) {
+                    error = _journalPath + ": " + strerror(errno);
+                    return false;
+                }
+            }
+            _journal = fopen(_journalPath.c_str(), "a");
+            if (_journal == NULL) {
+                error = _journalPath + ": " + strerror(errno);
+                return false;
+            }
+            return resume || commit(0.0);
+        }
+
+        /**
+         * @return true if image was completed by an earlier run
+         */
+        bool isCompleted(const std::string& path) const {
+            return _completedPaths.count(path) > 0;
+        }
+
+        /**
+         * @return row of image completed by an earlier run or NULL
+         */
+        const CheckpointRow *getCompleted(const std::string& path) const {
+            std::unordered_map<std::string, std::size_t>::const_iterator itr =
+                    _completedPaths.find(path);
+            if (itr == _completedPaths.end()) {
+                return NULL;
+            }
+            return &_completed[itr->second];
+        }
+
+        /**
+         * @return rows of images completed by earlier runs in the order they
+         *         completed
+         */
+        const std::vector<CheckpointRow> &getCompletedRows() const {
+            return _completed;
+        }
+
+        /**
+         * Seconds spent in earlier runs, to be added to this run's time
+         */
+        double getPreviousSeconds() const {
+            return _previousSeconds;
+        }
+
+        /**
+         * Records completed image, commits a checkpoint every interval
+         * images
+         * @param csv the image's output row without newline
+         * @param positive
+         * @param total
+         * @param seconds seconds elapsed in this run
+         * @return false if checkpoint could not be written
+         */
+        bool add(const std::string& csv, int positive, int total,
+                double seconds) {
+            _images++;
+            _totalPositive += positive;
+            _total += total;
+            if (fprintf(_journal, "%s\n", csv.c_str()) < 0) {
+                return false;
+            }
+            if (++_sinceCommit >= _interval) {
+                return commit(seconds);
+            }
+            return true;
+        }
+
+        /**
+         * Syncs journal and atomically replaces state file
+         * @param seconds seconds elapsed in this run
+         * @return false upon failure
+         */
+        bool commit(double seconds) {
+            if (fflush(_journal) != 0 || fsync(fileno(_journal)) != 0) {
+                return false;
+            }
+            long journalBytes = ftell(_journal);
+            std::string tmpPath = _statePath + ".tmp";
+            FILE *fp = fopen(tmpPath.c_str(), "w");
+            if (fp == NULL) {
+                return false;
+            }
+            fprintf(fp, "stereopointcounter-checkpoint 1\n"
+                    "gridx %d\ngridy %d\nthreshold %d\njournalbytes %ld\n"
+                    "images %ld\npositive %lld\ntotal %lld\nseconds %.17g\n",
+                    _gridX, _gridY, _threshold, journalBytes, _images,
+                    _totalPositive, _total, _previousSeconds + seconds);
+            bool ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+            ok = fclose(fp) == 0 && ok;
+            if (!ok || rename(tmpPath.c_str(), _statePath.c_str()) != 0) {
+                return false;
+            }
+            _committedBytes = journalBytes;
+            _sinceCommit = 0;
+            return true;
+        }
+
+    private:
+        Checkpoint(const Checkpoint& orig);
+        Checkpoint& operator=(const Checkpoint& orig);
+
+        bool loadState(std::string& error) {
+            std::ifstream in(_statePath.c_str());
+            std::string magic;
+            int version = 0;
+            if (!(in >> magic >> version) ||
+                magic != "stereopointcounter-checkpoint" || version != 1) {
+                error = _statePath + " is not a checkpoint file";
+                return false;
+            }
+            std::string key;
+            int gridX = -1;
+            int gridY = -1;
+            int threshold = -1;
+            while (in >> key) {
+                if (key == "gridx") {
+                    in >> gridX;
+                } else if (key == "gridy") {
+                    in >> gridY;
+                } else if (key == "threshold") {
+                    in >> threshold;
+                } else if (key == "journalbytes") {
+                    in >> _committedBytes;
+                } else if (key == "seconds") {
+                    in >> _previousSeconds;
+                } else {
+                    std::string ignored;
+                    in >> ignored;
+                }
+            }
+            if (gridX != _gridX || gridY != _gridY || threshold != _threshold) {
+                error = _statePath + " was written with different --gridx, "
+                        "--gridy or --threshold";
+                return false;
+            }
+            return true;
+        }
+
+        bool loadJournal(std::string& error) {
+            // anything past the committed length may be partial
+            if (truncate(_journalPath.c_str(), _committedBytes) != 0) {
+                error = _journalPath + ": " + strerror(errno);
+                return false;
+            }
+            std::ifstream in(_journalPath.c_str());
+            std::string line;
+            while (std::getline(in, line)) {
+                // Image,GridSize,GridSizePixel,Positive,Total, path may
+                // contain commas so split from the right
+                CheckpointRow row;
+                row.csv = line;
+                std::size_t comma = line.size();
+                std::size_t fields[4];
+                bool ok = true;
+                for (int i = 0; i < 4 && ok; i++) {
+                    comma = comma == 0 ? std::string::npos :
+                            line.find_last_of(',', comma - 1);
+                    ok = comma != std::string::npos;
+                    fields[i] = comma;
+                }
+                if (!ok) {
+                    error = _journalPath + " has malformed line: " + line;
+                    return false;
+                }
+                row.path = line.substr(0, fields[3]);
+                row.gridWidth = 0;
+                row.gridHeight = 0;
+                sscanf(line.c_str() + fields[2] + 1, "%dx%d", &row.gridWidth,
+                        &row.gridHeight);
+                row.positive = atoi(line.c_str() + fields[1] + 1);
+                row.total = atoi(line.c_str() + fields[0] + 1);
+                _images++;
+                _totalPositive += row.positive;
+                _total += row.total;
+                _completedPaths[row.path] = _completed.size();
+                _completed.push_back(row);
+            }
+            return true;
+        }
+
+        std::string _statePath;
+        std::string _journalPath;
+        FILE *_journal;
+        int _interval;
+        int _sinceCommit;
+        long _committedBytes;
+        int _gridX;
+        int _gridY;
+        int _threshold;
+        double _previousSeconds;
+        long _images;
+        long long _totalPositive;
+        long long _total;
+        std::vector<CheckpointRow> _completed;
+        std::unordered_map<std::string, std::size_t> _completedPaths;
+    };
+}
+
+#endif	/* CHECKPOINT_HPP */
@@ -0,0 +1,428 @@
+/*
+ * File:   ColumnarResults.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef COLUMNARRESULTS_HPP
+#define	COLUMNARRESULTS_HPP
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+namespace spc {
+
+    /**
+     * Value types of columns in a columnar results file
+     */
+    enum ColumnType {
+        COLUMN_BYTES = 0, COLUMN_INT32 = 1, COLUMN_UINT64 = 2
+    };
+
+    /**
+     * Header at offset 0 of a columnar results file
+     */
+    struct ColumnarHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrderMark;
+        uint64_t numRows;
+        uint64_t columnTableOffset;
+        uint32_t numColumns;
+        int32_t gridX;
+        int32_t gridY;
+        int32_t threshold;
+        int32_t failedImages;
+        uint32_t reserved;
+        double seconds;
+    };
+
+    /**
+     * Entry of the column table
+     */
+    struct ColumnarColumn {
+        char name[24];
+        uint32_t type;
+        uint32_t valueBytes;
+        uint64_t offset;
+        uint64_t bytes;
+    };
+
+    static_assert(sizeof (ColumnarHeader) == 64, "header must be packed");
+    static_assert(sizeof (ColumnarColumn) == 48, "column must be packed");
+
+    const char COLUMNAR_MAGIC[8] = {'S', 'P', 'C', 'C', 'O', 'L', 'S', '\0'};
+    const uint32_t COLUMNAR_BYTE_ORDER_MARK = 0x01020304;
+
+    /**
+     * Writes per image results as a columnar binary file.
+     *
+     * Layout, all sections 8 byte aligned and in native (little endian)
+     * byte order:
+     *
+     *   ColumnarHeader
+     *   path_data    concatenated image paths, no separators
+     *   path_offset  uint64 x (rows + 1), path i is
+     *                path_data[path_offset[i], path_offset[i + 1])
+     *   grid_width   int32 x rows, pixel spacing of vertical grid lines
+     *   grid_height  int32 x rows, pixel spacing of horizontal grid lines
+     *   positive     int32 x rows
+     *   total        int32 x rows
+     *   ColumnarColumn x numColumns
+     *
+     * gridx, gridy and threshold are the same for every row so they are
+     * stored once in the header along with the summary.  Paths are written
+     * as rows arrive, the fixed width columns (24 bytes per row) are kept in
+     * memory until close().
+     */
+    class ColumnarResultWriter {
+    public:
+
+        ColumnarResultWriter() : _fd(-1), _pathBytes(0) {
+            memset(&_header, 0, sizeof (_header));
+        }
+
+        virtual ~ColumnarResultWriter() {
+            if (_fd >= 0) {
+                ::close(_fd);
+            }
+        }
+
+        /**
+         * Creates file, replacing any existing one
+         * @param error set to reason upon failure
+         * @return false upon failure
+         */
+        bool open(const std::string& path, int gridX, int gridY,
+                int threshold, std::string& error) {
+            _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+            if (_fd < 0) {
+                error = strerror(errno);
+                return false;
+            }
+            memcpy(_header.magic, COLUMNAR_MAGIC, sizeof (_header.magic));
+            _header.version = 1;
+            _header.byteOrderMark = COLUMNAR_BYTE_ORDER_MARK;
+            _header.gridX = gridX;
+            _header.gridY = gridY;
+            _header.threshold = threshold;
+            _pathOffsets.push_back(0);
+            _pathBuffer.reserve(1 << 20);
+            // header is rewritten with final values by close()
+            if (!writeFully(&_header, sizeof (_header))) {
+                error = strerror(errno);
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * Adds one image's results
+         * @return false if write failed
+         */
+        bool add(const std::string& path, int gridWidth, int gridHeight,
+                int positive, int total) {
+            if (_pathBuffer.size() + path.size() > _pathBuffer.capacity() &&
+                !flushPaths()) {
+                return false;
+            }
+            _pathBuffer.insert(_pathBuffer.end(), path.begin(), path.end());
+            _pathBytes += path.size();
+            _pathOffsets.push_back(_pathBytes);
+            _gridWidth.push_back(gridWidth);
+            _gridHeight.push_back(gridHeight);
+            _positive.push_back(positive);
+            _total.push_back(total);
+            return true;
+        }
+
+        /**
+         * Writes columns, column table and header and closes file
+         * @param seconds run time for the summary
+         * @param failedImages number of images that failed
+         * @return false if write failed
+         */
+        bool close(double seconds, int failedImages) {
+            bool ok = flushPaths();
+            uint64_t offset = sizeof (_header);
+            addColumn("path_data", COLUMN_BYTES, 1, offset, _pathBytes);
+            offset += _pathBytes;
+            ok = ok && pad(offset);
+            ok = ok && writeColumn("path_offset", COLUMN_UINT64, _pathOffsets,
+                    offset);
+            ok = ok && writeColumn("grid_width", COLUMN_INT32, _gridWidth,
+                    offset);
+            ok = ok && writeColumn("grid_height", COLUMN_INT32, _gridHeight,
+                    offset);
+            ok = ok && writeColumn("positive", COLUMN_INT32, _positive, offset);
+            ok = ok && writeColumn("total", COLUMN_INT32, _total, offset);
+
+            _header.numRows = _total.size();
+            _header.columnTableOffset = offset;
+            _header.numColumns = _columns.size();
+            _header.seconds = seconds;
+            _header.failedImages = failedImages;
+            ok = ok && writeFully(&_columns[0],
+                    _columns.size() * sizeof (ColumnarColumn));
+            ok = ok && pwrite(_fd, &_header, sizeof (_header), 0) ==
+                    (ssize_t) sizeof (_header);
+            ok = ::close(_fd) == 0 && ok;
+            _fd = -1;
+            return ok;
+        }
+
+    private:
+        ColumnarResultWriter(const ColumnarResultWriter& orig);
+        ColumnarResultWriter& operator=(const ColumnarResultWriter& orig);
+
+        bool writeFully(const void *data, std::size_t len) {
+            const char *ptr = (const char *) data;
+            while (len > 0) {
+                ssize_t numWritten = ::write(_fd, ptr, len);
+                if (numWritten < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (numWritten <= 0) {
+                    return false;
+                }
+                ptr += numWritten;
+                len -= numWritten;
+            }
+            return true;
+        }
+
+        bool flushPaths() {
+            bool ok = _pathBuffer.empty() ||
+                    writeFully(&_pathBuffer[0], _pathBuffer.size());
+            _pathBuffer.clear();
+            return ok;
+        }
+
+        /**
+         * Pads file to next multiple of 8 bytes
+         */
+        bool pad(uint64_t &offset) {
+            static const char zeros[8] = {0};
+            std::size_t len = (8 - offset % 8) % 8;
+            offset += len;
+            return writeFully(zeros, len);
+        }
+
+        void addColumn(const char *name, ColumnType type, uint32_t valueBytes,
+                uint64_t offset, uint64_t bytes) {
+            ColumnarColumn column;
+            memset(&column, 0, sizeof (column));
+            strncpy(column.name, name, sizeof (column.name) - 1);
+            column.type = type;
+            column.valueBytes = valueBytes;
+            column.offset = offset;
+            column.bytes = bytes;
+            _columns.push_back(column);
+        }
+
+        template<typename T>
+        bool writeColumn(const char *name, ColumnType type,
+                const std::vector<T> &values, uint64_t &offset) {
+            uint64_t bytes = values.size() * sizeof (T);
+            addColumn(name, type, sizeof (T), offset, bytes);
+            offset += bytes;
+            return (values.empty() || writeFully(&values[0], bytes)) &&
+                    pad(offset);
+        }
+
+        int _fd;
+        ColumnarHeader _header;
+        std::vector<ColumnarColumn> _columns;
+        std::vector<char> _pathBuffer;
+        uint64_t _pathBytes;
+        std::vector<uint64_t> _pathOffsets;
+        std::vector<int32_t> _gridWidth;
+        std::vector<int32_t> _gridHeight;
+        std::vector<int32_t> _positive;
+        std::vector<int32_t> _total;
+    };
+
+    /**
+     * Memory maps a file written by ColumnarResultWriter.  Opening only
+     * validates the header, column table and path offsets, columns are
+     * used in place so scanning millions of rows costs no parsing or
+     * copying.
+     */
+    class ColumnarResults {
+    public:
+
+        ColumnarResults() : _map(NULL), _mapBytes(0), _header(NULL),
+        _pathData(NULL), _pathDataBytes(0), _pathOffsets(NULL), _gridWidth(NULL),
+        _gridHeight(NULL), _positive(NULL), _total(NULL) {
+        }
+
+        virtual ~ColumnarResults() {
+            if (_map != NULL) {
+                munmap(_map, _mapBytes);
+            }
+        }
+
+        /**
+         * @param error set to reason upon failure
+         * @return false if file could not be mapped or is not a valid
+         *         columnar results file
+         */
+        bool open(const std::string& path, std::string& error) {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                error = strerror(errno);
+                return false;
+            }
+            struct stat st;
+            if (fstat(fd, &st) != 0 ||
+                (std::size_t) st.st_size < sizeof (ColumnarHeader)) {
+                ::close(fd);
+                error = "not a columnar results file";
+                return false;
+            }
+            _mapBytes = st.st_size;
+            void *map = mmap(NULL, _mapBytes, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (map == MAP_FAILED) {
+                error = strerror(errno);
+                return false;
+            }
+            _map = map;
+            _header = (const ColumnarHeader *) _map;
+            if (memcmp(_header->magic, COLUMNAR_MAGIC, 8) != 0 ||
+                _header->version != 1 ||
+                _header->byteOrderMark != COLUMNAR_BYTE_ORDER_MARK ||
+                _header->numRows > _mapBytes / sizeof (uint64_t) ||
+                _header->columnTableOffset % 8 != 0 ||
+                _header->columnTableOffset > _mapBytes ||
+                _header->numColumns > (_mapBytes -
+                _header->columnTableOffset) / sizeof (ColumnarColumn)) {
+                error = "not a columnar results file or wrong byte order";
+                return false;
+            }
+            uint64_t rows = _header->numRows;
+            _pathData = (const char *) findColumn("path_data", COLUMN_BYTES,
+                    1, (uint64_t) -1);
+            _pathOffsets = (const uint64_t *) findColumn("path_offset",
+                    COLUMN_UINT64, 8, rows + 1);
+            _gridWidth = (const int32_t *) findColumn("grid_width",
+                    COLUMN_INT32, 4, rows);
+            _gridHeight = (const int32_t *) findColumn("grid_height",
+                    COLUMN_INT32, 4, rows);
+            _positive = (const int32_t *) findColumn("positive", COLUMN_INT32,
+                    4, rows);
+            _total = (const int32_t *) findColumn("total", COLUMN_INT32, 4,
+                    rows);
+            if (_pathData == NULL || _pathOffsets == NULL ||
+                _gridWidth == NULL || _gridHeight == NULL ||
+                _positive == NULL || _total == NULL ||
+                _pathOffsets[rows] > _pathDataBytes) {
+                error = "columnar results file is missing or has truncated "
+                        "columns";
+                return false;
+            }
+            for (uint64_t i = 0; i < rows; i++) {
+                if (_pathOffsets[i + 1] < _pathOffsets[i]) {
+                    error = "columnar results file has bad path offsets";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::size_t getNumRows() const {
+            return _header->numRows;
+        }
+
+        const ColumnarHeader &getHeader() const {
+            return *_header;
+        }
+
+        /**
+         * @return path of image in row i
+         */
+        std::string getPath(std::size_t i) const {
+            return std::string(_pathData + _pathOffsets[i],
+                    _pathOffsets[i + 1] - _pathOffsets[i]);
+        }
+
+        const uint64_t *getPathOffsets() const {
+            return _pathOffsets;
+        }
+
+        const char *getPathData() const {
+            return _pathData;
+        }
+
+        const int32_t *getGridWidth() const {
+            return _gridWidth;
+        }
+
+        const int32_t *getGridHeight() const {
+            return _gridHeight;
+        }
+
+        const int32_t *getPositive() const {
+            return _positive;
+        }
+
+        const int32_t *getTotal() const {
+            return _total;
+        }
+
+    private:
+        ColumnarResults(const ColumnarResults& orig);
+        ColumnarResults& operator=(const ColumnarResults& orig);
+
+        /**
+         * @param count required number of values, -1 for any
+         * @return start of column or NULL if missing or out of bounds
+         */
+        const void *findColumn(const char *name, ColumnType type,
+                uint32_t valueBytes, uint64_t count) {
+            const ColumnarColumn *columns = (const ColumnarColumn *)
+                    ((const char *) _map + _header->columnTableOffset);
+            for (uint32_t i = 0; i < _header->numColumns; i++) {
+                const ColumnarColumn &c = columns[i];
+                if (strncmp(c.name, name, sizeof (c.name)) != 0) {
+                    continue;
+                }
+                if (c.type != (uint32_t) type || c.valueBytes != valueBytes ||
+                    c.offset % valueBytes != 0 || c.offset > _mapBytes ||
+                    c.bytes > _mapBytes - c.offset ||
+                    (count != (uint64_t) -1 &&
+                    c.bytes != count * valueBytes)) {
+                    return NULL;
+                }
+                if (type == COLUMN_BYTES) {
+                    _pathDataBytes = c.bytes;
+                }
+                return (const char *) _map + c.offset;
+            }
+            return NULL;
+        }
+
+        void *_map;
+        std::size_t _mapBytes;
+        const ColumnarHeader *_header;
+        const char *_pathData;
+        uint64_t _pathDataBytes;
+        const uint64_t *_pathOffsets;
+        const int32_t *_gridWidth;
+        const int32_t *_gridHeight;
+        const int32_t *_positive;
+        const int32_t *_total;
+    };
+}
+
+#endif	/* COLUMNARRESULTS_HPP */
@@ -0,0 +1,247 @@
+/*
+ * File:   DeepZoomWriter.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef DEEPZOOMWRITER_HPP
+#define	DEEPZOOMWRITER_HPP
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "itkImage.h"
+#include "PngWriter.hpp"
+
+namespace spc {
+
+    /**
+     * Writes an RGB image as a Deep Zoom tile pyramid
+     * (http://schemas.microsoft.com/deepzoom/2008) while the caller streams
+     * in rows from top to bottom.  Output is a <base>.dzi descriptor and
+     * <base>_files/<level>/<column>_<row>.png tiles with no overlap.
+     *
+     * Only one band of tileSize rows is buffered per zoom level.  Each band
+     * is cut into tiles which are encoded in parallel, then averaged 2x2 into
+     * the next smaller level.
+     */
+    class DeepZoomWriter {
+    public:
+
+        /**
+         * @param basePath output path without extension
+         * @param width full resolution width in pixels
+         * @param height full resolution height in pixels
+         * @param tileSize tile width and height in pixels
+         * @param numThreads number of threads used to encode tiles, 0 means
+         *        use number of hardware threads
+         */
+        DeepZoomWriter(const std::string& basePath, int width, int height,
+                int tileSize = 256, int numThreads = 0) :
+        _basePath(basePath), _width(width), _height(height),
+        _tileSize(tileSize), _numThreads(numThreads) {
+            if (_numThreads <= 0) {
+                _numThreads = std::thread::hardware_concurrency();
+            }
+            if (_numThreads <= 0) {
+                _numThreads = 1;
+            }
+            int maxLevel = 0;
+            while ((1L << maxLevel) < width || (1L << maxLevel) < height) {
+                maxLevel++;
+            }
+            _levels.resize(maxLevel + 1);
+            int levelWidth = width;
+            int levelHeight = height;
+            for (int level = maxLevel; level >= 0; level--) {
+                Level &l = _levels[level];
+                l.width = levelWidth;
+                l.height = levelHeight;
+                l.bandRows = 0;
+                l.rowsDone = 0;
+                l.hasPending = false;
+                l.band.resize((std::size_t) tileSize * levelWidth * 3);
+                l.pending.resize((std::size_t) levelWidth * 3);
+                levelWidth = (levelWidth + 1) / 2;
+                levelHeight = (levelHeight + 1) / 2;
+            }
+            makeDirectory(_basePath + "_files");
+            for (std::size_t level = 0; level < _levels.size(); level++) {
+                std::ostringstream os;
+                os << _basePath << "_files/" << level;
+                makeDirectory(os.str());
+            }
+        }
+
+        virtual ~DeepZoomWriter() {
+        }
+
+        /**
+         * Adds next full resolution row
+         * @param row width r,g,b triplets
+         */
+        void addRow(const unsigned char *row) {
+            addRow(_levels.size() - 1, row);
+        }
+
+        /**
+         * Flushes remaining partial bands and writes the .dzi descriptor.
+         * Must be called after the last row.
+         */
+        void close() {
+            for (int level = _levels.size() - 1; level >= 0; level--) {
+                Level &l = _levels[level];
+                if (l.hasPending && level > 0) {
+                    // odd number of rows, last row has no partner
+                    addRow(level - 1, downsample(l, &l.pending[0], &l.pending[0]));
+                    l.hasPending = false;
+                }
+                if (l.bandRows > 0) {
+                    flushBand(level);
+                }
+            }
+            std::string dzi = _basePath + ".dzi";
+            std::ofstream out(dzi.c_str());
+            out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl
+                    << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\""
+                    << " TileSize=\"" << _tileSize << "\" Overlap=\"0\""
+                    << " Format=\"png\">" << std::endl
+                    << "  <Size Width=\"" << _width << "\" Height=\""
+                    << _height << "\"/>" << std::endl
+                    << "</Image>" << std::endl;
+            out.close();
+            if (!out) {
+                throw itk::ExceptionObject(__FILE__, __LINE__,
+                        "Error writing " + dzi, "spc::DeepZoomWriter");
+            }
+        }
+
+    private:
+
+        struct Level {
+            int width;
+            int height;
+            int bandRows;
+            int rowsDone;
+            bool hasPending;
+            std::vector<unsigned char> band;
+            std::vector<unsigned char> pending;
+            std::vector<unsigned char> half;
+        };
+
+        void makeDirectory(const std::string& path) {
+            if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+                throw itk::ExceptionObject(__FILE__, __LINE__,
+                        "Unable to create directory " + path,
+                        "spc::DeepZoomWriter");
+            }
+        }
+
+        void addRow(int level, const unsigned char *row) {
+            Level &l = _levels[level];
+            std::size_t rowBytes = (std::size_t) l.width * 3;
+            std::copy(row, row + rowBytes, &l.band[l.bandRows * rowBytes]);
+            l.bandRows++;
+
+            if (level > 0) {
+                if (l.hasPending) {
+                    const unsigned char *half = downsample(l, &l.pending[0], row);
+                    l.hasPending = false;
+                    addRow(level - 1, half);
+                } else {
+                    std::copy(row, row + rowBytes, l.pending.begin());
+                    l.hasPending = true;
+                }
+            }
+            if (l.bandRows == _tileSize) {
+                flushBand(level);
+            }
+        }
+
+        /**
+         * Averages two rows 2x2 into a row of the next level
+         */
+        const unsigned char *downsample(Level &l, const unsigned char *top,
+                const unsigned char *bottom) {
+            int halfWidth = (l.width + 1) / 2;
+            l.half.resize((std::size_t) halfWidth * 3);
+            for (int x = 0; x < halfWidth; x++) {
+                int x0 = 2 * x;
+                int x1 = x0 + 1 < l.width ? x0 + 1 : x0;
+                for (int c = 0; c < 3; c++) {
+                    int sum = top[3 * x0 + c] + top[3 * x1 + c] +
+                            bottom[3 * x0 + c] + bottom[3 * x1 + c];
+                    l.half[3 * x + c] = (sum + 2) / 4;
+                }
+            }
+            return &l.half[0];
+        }
+
+        void flushBand(int level) {
+            Level &l = _levels[level];
+            int tileRow = l.rowsDone / _tileSize;
+            int numTiles = (l.width + _tileSize - 1) / _tileSize;
+            int numThreads = std::min(_numThreads, numTiles);
+
+            std::vector<std::exception_ptr> errors(numThreads);
+            std::vector<std::thread> threads;
+            for (int t = 1; t < numThreads; t++) {
+                threads.push_back(std::thread(&DeepZoomWriter::writeTiles,
+                        this, level, tileRow, t, numThreads, &errors[t]));
+            }
+            writeTiles(level, tileRow, 0, numThreads, &errors[0]);
+            for (std::size_t t = 0; t < threads.size(); t++) {
+                threads[t].join();
+            }
+            l.rowsDone += l.bandRows;
+            l.bandRows = 0;
+            for (std::size_t t = 0; t < errors.size(); t++) {
+                if (errors[t]) {
+                    std::rethrow_exception(errors[t]);
+                }
+            }
+        }
+
+        void writeTiles(int level, int tileRow, int first, int step,
+                std::exception_ptr *error) {
+            try {
+                const Level &l = _levels[level];
+                std::size_t rowBytes = (std::size_t) l.width * 3;
+                int numTiles = (l.width + _tileSize - 1) / _tileSize;
+                for (int col = first; col < numTiles; col += step) {
+                    int x = col * _tileSize;
+                    int tileWidth = std::min(_tileSize, l.width - x);
+                    std::ostringstream os;
+                    os << _basePath << "_files/" << level << "/" << col << "_"
+                            << tileRow << ".png";
+                    PngWriter writer;
+                    writer.open(os.str(), tileWidth, l.bandRows, PngWriter::RGB);
+                    for (int y = 0; y < l.bandRows; y++) {
+                        writer.writeRow(&l.band[y * rowBytes + 3 * x]);
+                    }
+                    writer.close();
+                }
+            } catch (...) {
+                *error = std::current_exception();
+            }
+        }
+
+        std::string _basePath;
+        int _width;
+        int _height;
+        int _tileSize;
+        int _numThreads;
+        std::vector<Level> _levels;
+    };
+}
+
+#endif	/* DEEPZOOMWRITER_HPP */
@@ -0,0 +1,290 @@
+/*
+ * File:   DirectoryScanner.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef DIRECTORYSCANNER_HPP
+#define	DIRECTORYSCANNER_HPP
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace spc {
+
+    /**
+     * Settings for scanDirectory()
+     */
+    struct ScanOptions {
+
+        ScanOptions() : recursive(false), numThreads(1) {
+            patterns.push_back("*.png");
+        }
+
+        /**
+         * If true descend into subdirectories.  Symbolic links to
+         * directories are not followed.
+         */
+        bool recursive;
+
+        /**
+         * fnmatch() style patterns matched against file names.  A file is
+         * kept if it matches any of them.
+         */
+        std::vector<std::string> patterns;
+
+        /**
+         * Number of threads scanning subdirectories in parallel
+         */
+        int numThreads;
+    };
+
+    /**
+     * Matches file names against ScanOptions::patterns.  Patterns of the
+     * form *.suffix are checked with a plain suffix compare, everything
+     * else goes through fnmatch().  Both follow FNM_PERIOD, a leading dot
+     * of a name is only matched by a literal dot, so *.png does not
+     * match .hidden.png.
+     */
+    class FileNameFilter {
+    public:
+
+        FileNameFilter(const std::vector<std::string>& patterns) {
+            for (std::size_t i = 0; i < patterns.size(); i++) {
+                const std::string &p = patterns[i];
+                if (p.length() > 1 && p[0] == '*' &&
+                    p.find_first_of("*?[\\", 1) == std::string::npos) {
+                    _suffixes.push_back(p.substr(1));
+                } else {
+                    _globs.push_back(p);
+                }
+            }
+        }
+
+        bool matches(const char *name, std::size_t nameLen) const {
+            // * never matches the leading dot of a hidden file
+            for (std::size_t i = 0; name[0] != '.' && i < _suffixes.size();
+                    i++) {
+                const std::string &s = _suffixes[i];
+                if (nameLen >= s.length() &&
+                    memcmp(name + nameLen - s.length(), s.data(),
+                           s.length()) == 0) {
+                    return true;
+                }
+            }
+            for (std::size_t i = 0; i < _globs.size(); i++) {
+                if (fnmatch(_globs[i].c_str(), name, FNM_PERIOD) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        std::vector<std::string> _suffixes;
+        std::vector<std::string> _globs;
+    };
+
+    /**
+     * Reads the entries of one directory.  On Linux entries are fetched in
+     * large batches with getdents64 and the d_type field is used so no
+     * stat() is needed unless the filesystem does not report types.
+     * @param directory directory to read
+     * @param filter filter applied to file names
+     * @param files matching files are appended as directory/name
+     * @param subdirs if not NULL subdirectories are appended as
+     *        directory/name
+     */
+    void scanOneDirectory(const std::string& directory,
+            const FileNameFilter& filter, std::vector<std::string>& files,
+            std::vector<std::string> *subdirs) {
+#ifdef __linux__
+        struct LinuxDirent64 {
+            ino64_t d_ino;
+            off64_t d_off;
+            unsigned short d_reclen;
+            unsigned char d_type;
+            char d_name[];
+        };
+        int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        std::vector<char> buffer(1 << 20);
+        long numRead;
+        while ((numRead = syscall(SYS_getdents64, fd, &buffer[0],
+                buffer.size())) > 0) {
+            for (long pos = 0; pos < numRead;) {
+                LinuxDirent64 *ent = (LinuxDirent64 *) (&buffer[pos]);
+                pos += ent->d_reclen;
+                const char *name = ent->d_name;
+                if (name[0] == '.' && (name[1] == '\0' ||
+                    (name[1] == '.' && name[2] == '\0'))) {
+                    continue;
+                }
+                unsigned char type = ent->d_type;
+                if (type == DT_UNKNOWN) {
+                    struct stat st;
+                    if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+                        S_ISDIR(st.st_mode)) {
+                        type = DT_DIR;
+                    }
+                }
+                if (type == DT_DIR) {
+                    if (subdirs != NULL) {
+                        subdirs->push_back(directory + "/" + name);
+                    }
+                    continue;
+                }
+                if (filter.matches(name, strlen(name))) {
+                    files.push_back(directory + "/" + name);
+                }
+            }
+        }
+        close(fd);
+#else
+        DIR *dir = opendir(directory.c_str());
+        if (dir == NULL) {
+            return;
+        }
+        struct dirent *dirEnt;
+        while ((dirEnt = readdir(dir)) != NULL) {
+            const char *name = dirEnt->d_name;
+            if (name[0] == '.' && (name[1] == '\0' ||
+                (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            std::string path = directory + "/" + name;
+            struct stat st;
+            if (lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+                if (subdirs != NULL) {
+                    subdirs->push_back(path);
+                }
+                continue;
+            }
+            if (filter.matches(name, strlen(name))) {
+                files.push_back(path);
+            }
+        }
+        closedir(dir);
+#endif
+    }
+
+    /**
+     * Work queue of directories shared by scanDirectory() threads
+     */
+    class DirectoryScanQueue {
+    public:
+
+        DirectoryScanQueue(const FileNameFilter& filter) : _filter(filter),
+        _busy(0) {
+        }
+
+        void push(const std::string& directory) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _pending.push_back(directory);
+        }
+
+        /**
+         * Scans directories until none are queued and no thread is busy
+         * (and so could queue more).  Matches go to files.
+         */
+        void run(std::vector<std::string> *files) {
+            std::vector<std::string> subdirs;
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true) {
+                while (_pending.empty() && _busy > 0) {
+                    _cond.wait(lock);
+                }
+                if (_pending.empty()) {
+                    break;
+                }
+                std::string directory = _pending.back();
+                _pending.pop_back();
+                _busy++;
+                lock.unlock();
+
+                subdirs.clear();
+                scanOneDirectory(directory, _filter, *files, &subdirs);
+
+                lock.lock();
+                _pending.insert(_pending.end(), subdirs.begin(), subdirs.end());
+                _busy--;
+                _cond.notify_all();
+            }
+        }
+
+    private:
+        const FileNameFilter &_filter;
+        std::deque<std::string> _pending;
+        std::mutex _mutex;
+        std::condition_variable _cond;
+        int _busy;
+    };
+
+    /**
+     * Lists files in directory (and below it if options.recursive is set)
+     * whose names match options.patterns.
+     * @param directory
+     * @param options
+     * @return full paths of matching files sorted in byte order
+     */
+    std::vector<std::string> scanDirectory(const std::string& directory,
+            const ScanOptions& options) {
+        FileNameFilter filter(options.patterns);
+        std::vector<std::string> files;
+        if (!options.recursive) {
+            scanOneDirectory(directory, filter, files, NULL);
+            std::sort(files.begin(), files.end());
+            return files;
+        }
+
+        int numThreads = std::max(options.numThreads, 1);
+        DirectoryScanQueue queue(filter);
+        queue.push(directory);
+        std::vector< std::vector<std::string> > threadFiles(numThreads);
+        std::vector<std::thread> threads;
+        for (int t = 1; t < numThreads; t++) {
+            threads.push_back(std::thread(&DirectoryScanQueue::run, &queue,
+                    &threadFiles[t]));
+        }
+        queue.run(&threadFiles[0]);
+        for (std::size_t t = 0; t < threads.size(); t++) {
+            threads[t].join();
+        }
+
+        std::size_t total = 0;
+        for (int t = 0; t < numThreads; t++) {
+            total += threadFiles[t].size();
+        }
+        files.reserve(total);
+        for (int t = 0; t < numThreads; t++) {
+            files.insert(files.end(),
+                    std::make_move_iterator(threadFiles[t].begin()),
+                    std::make_move_iterator(threadFiles[t].end()));
+            std::vector<std::string>().swap(threadFiles[t]);
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+}
+
+#endif	/* DIRECTORYSCANNER_HPP */
@@ -0,0 +1,233 @@
+/*
+ * File:   GroupSummary.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef GROUPSUMMARY_HPP
+#define	GROUPSUMMARY_HPP
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <map>
+#include <regex>
+#include <string>
+
+#include "OutputBuffer.hpp"
+
+namespace spc {
+
+    /**
+     * Running sums of one group of images.  Besides the totals these hold
+     * what the coefficient of error of the group's ratio estimate
+     * (positive / total over all images) needs, so a group takes the same
+     * memory whatever its number of images.
+     */
+    struct GroupTotals {
+
+        GroupTotals() : images(0), positive(0), total(0), sumPP(0.0),
+        sumTT(0.0), sumPT(0.0) {
+        }
+
+        void add(int imagePositive, int imageTotal) {
+            images++;
+            positive += imagePositive;
+            total += imageTotal;
+            sumPP += (double) imagePositive * imagePositive;
+            sumTT += (double) imageTotal * imageTotal;
+            sumPT += (double) imagePositive * imageTotal;
+        }
+
+        /**
+         * Coefficient of error of positive / total with the images as
+         * sampling units (Cruz-Orive's ratio estimator formula):
+         *
+         *     CE^2 = n / (n - 1) * (sum P^2 / (sum P)^2 + sum T^2 / (sum T)^2
+         *            - 2 sum PT / (sum P sum T))
+         *
+         * @param ce set to coefficient of error
+         * @return false if undefined, with fewer than 2 images or no
+         *         positive intersections
+         */
+        bool getCE(double &ce) const {
+            if (images < 2 || positive <= 0 || total <= 0) {
+                return false;
+            }
+            double p = (double) positive;
+            double t = (double) total;
+            double ce2 = (double) images / (images - 1) * (sumPP / (p * p) +
+                    sumTT / (t * t) - 2.0 * sumPT / (p * t));
+            // rounding can take a zero variance just below 0
+            ce = ce2 > 0.0 ? sqrt(ce2) : 0.0;
+            return true;
+        }
+
+        long images;
+        long long positive;
+        long long total;
+        double sumPP;
+        double sumTT;
+        double sumPT;
+    };
+
+    /**
+     * Sums results per group of images for --groupby.  The group of an
+     * image comes from its path as reported in output, by one of:
+     *
+     *   depth:N    the first N directories of the path (fewer if the path
+     *              has fewer)
+     *   regex:RE   the first capture group, or the whole match if RE has
+     *              none, of the first match of ECMAScript regular
+     *              expression RE in the path
+     *
+     * Images a regex does not match are summed in a group with an empty
+     * name.
+     */
+    class GroupSummary {
+    public:
+
+        GroupSummary() : _enabled(false), _depth(0) {
+        }
+
+        /**
+         * Sets how images are grouped
+         * @param spec depth:N or regex:RE
+         * @param error set to reason upon failure
+         * @return false if spec is invalid
+         */
+        bool setSpec(const std::string& spec, std::string& error) {
+            std::size_t colon = spec.find(':');
+            std::string name = spec.substr(0, colon);
+            std::string value = colon == std::string::npos ? "" :
+                    spec.substr(colon + 1);
+            if (name == "depth") {
+                char *end = NULL;
+                long depth = strtol(value.c_str(), &end, 10);
+                if (value.empty() || *end != '\0' || depth < 1) {
+                    error = "depth:N requires N >= 1";
+                    return false;
+                }
+                _depth = depth;
+                _enabled = true;
+                return true;
+            }
+            if (name == "regex") {
+                try {
+                    _regex.assign(value, std::regex::ECMAScript);
+                } catch (std::regex_error& e) {
+                    error = std::string("invalid regex: ") + e.what();
+                    return false;
+                }
+                _depth = 0;
+                _enabled = true;
+                return true;
+            }
+            error = "must be depth:N or regex:RE";
+            return false;
+        }
+
+        bool isEnabled() const {
+            return _enabled;
+        }
+
+        /**
+         * Adds the counts of one image to its group
+         */
+        void add(const std::string& path, int positive, int total) {
+            if (_enabled) {
+                _groups[getGroup(path)].add(positive, total);
+            }
+        }
+
+        /**
+         * @return group of image at path
+         */
+        std::string getGroup(const std::string& path) const {
+            if (_depth > 0) {
+                std::size_t end = path.find_last_of('/');
+                if (end == std::string::npos) {
+                    return "";
+                }
+                std::size_t pos = path[0] == '/' ? 1 : 0;
+                for (int i = 0; i < _depth; i++) {
+                    std::size_t slash = path.find('/', pos);
+                    if (slash == std::string::npos || slash >= end) {
+                        return path.substr(0, end);
+                    }
+                    pos = slash + 1;
+                }
+                return path.substr(0, pos - 1);
+            }
+            std::smatch match;
+            if (!std::regex_search(path, match, _regex)) {
+                return "";
+            }
+            return match.size() > 1 ? match.str(1) : match.str(0);
+        }
+
+        /**
+         * Writes a CSV block of one row per group, sorted by name:
+         *
+         *     Group,Images,GroupTotalPositive,GroupTotal,CE
+         *
+         * CE is left empty where it is undefined
+         */
+        void writeCsv(OutputBuffer& out) const {
+            LineBuilder line;
+            out.write("\nGroup,Images,GroupTotalPositive,GroupTotal,CE\n");
+            for (std::map<std::string, GroupTotals>::const_iterator it =
+                    _groups.begin(); it != _groups.end(); ++it) {
+                const GroupTotals &totals = it->second;
+                line.clear();
+                line.append(it->first).append(',').append(totals.images)
+                        .append(',').append(totals.positive).append(',')
+                        .append(totals.total).append(',');
+                double ce;
+                if (totals.getCE(ce)) {
+                    line.append(ce);
+                }
+                out.writeLine(line);
+            }
+        }
+
+        /**
+         * Writes one --outputformat jsonl record of type group per group,
+         * sorted by name, with a null ce where it is undefined
+         */
+        void writeJsonLines(OutputBuffer& out) const {
+            LineBuilder line;
+            for (std::map<std::string, GroupTotals>::const_iterator it =
+                    _groups.begin(); it != _groups.end(); ++it) {
+                const GroupTotals &totals = it->second;
+                line.clear();
+                line.append("{\"type\":\"group\",\"group\":")
+                        .appendJsonString(it->first)
+                        .append(",\"images\":").append(totals.images)
+                        .append(",\"groupTotalPositive\":")
+                        .append(totals.positive)
+                        .append(",\"groupTotal\":").append(totals.total)
+                        .append(",\"ce\":");
+                double ce;
+                if (totals.getCE(ce)) {
+                    line.append(ce);
+                } else {
+                    line.append("null");
+                }
+                line.append('}');
+                out.writeLine(line);
+            }
+        }
+
+    private:
+        GroupSummary(const GroupSummary& orig);
+        GroupSummary& operator=(const GroupSummary& orig);
+
+        bool _enabled;
+        int _depth;
+        std::regex _regex;
+        std::map<std::string, GroupTotals> _groups;
+    };
+}
+
+#endif	/* GROUPSUMMARY_HPP */
@@ -0,0 +1,177 @@
+/*
+ * File:   ImageConverter.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef IMAGECONVERTER_HPP
+#define	IMAGECONVERTER_HPP
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+
+#include "ImageUtils.hpp"
+#include "MappedImage.hpp"
+#include "PngReader.hpp"
+#include "RowBlockImage.hpp"
+#include "StreamingSampler.hpp"
+#include "TiffReader.hpp"
+
+namespace spc {
+
+    /**
+     * Rows per block of converted images.  A block of a 10k pixel wide
+     * image is 160 KB, small enough that reading one grid row decodes
+     * little more than that row.
+     */
+    const int CONVERT_ROWS_PER_BLOCK = 16;
+
+    /**
+     * @param input image file found under root
+     * @param root directory or image file given to convert
+     * @param outputDir
+     * @return output path for input converted into outputDir: input's path
+     *         relative to root if root is a directory, otherwise its file
+     *         name, with the extension replaced by .spr
+     */
+    inline std::string getConvertedPath(const std::string& input,
+            const std::string& root, const std::string& outputDir) {
+        std::string name;
+        if (is_dir(root.c_str()) && input.size() > root.size() &&
+            input.compare(0, root.size(), root) == 0) {
+            std::size_t start = input.find_first_not_of('/', root.size());
+            name = start == std::string::npos ? "" : input.substr(start);
+        } else {
+            name = getFileNameFromPath(input);
+        }
+        std::size_t dot = name.find_last_of(".");
+        std::size_t slash = name.find_last_of("/");
+        if (dot != std::string::npos &&
+            (slash == std::string::npos || dot > slash)) {
+            name = name.substr(0, dot);
+        }
+        return outputDir + "/" + name + ".spr";
+    }
+
+    /**
+     * Creates the directories of path below outputDir that do not exist
+     * Throws itk::ExceptionObject upon failure.
+     * @param path file in outputDir, from getConvertedPath()
+     * @param outputDir
+     */
+    inline void makeParentDirectories(const std::string& path,
+            const std::string& outputDir) {
+        for (std::size_t slash = path.find('/', outputDir.size() + 1);
+                slash != std::string::npos;
+                slash = path.find('/', slash + 1)) {
+            std::string dir = path.substr(0, slash);
+            if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+                throw itk::ExceptionObject(__FILE__, __LINE__,
+                        "Unable to create directory " + dir + ": " +
+                        strerror(errno), "spc::makeParentDirectories");
+            }
+        }
+    }
+
+    /**
+     * Rewrites an image as a row block (.spr) image of the same 8-bit
+     * greyscale pixels the counter would see.  Non interlaced greyscale
+     * PNGs are converted a row at a time, 8-bit greyscale and RGB TIFFs a
+     * row of tiles or strip at a time and PGM and raw .u8 images straight
+     * from their mapping, anything else is decoded whole by ITK first.
+     * Throws itk::ExceptionObject upon failure.
+     * @param input image file
+     * @param output .spr file to write
+     */
+    inline void convertToRowBlocks(const std::string& input,
+            const std::string& output) {
+        unsigned char signature[8];
+        std::size_t len = readSignature(input, NULL, signature,
+                sizeof (signature));
+        RowBlockWriter writer;
+        if (isPngSignature(signature, len)) {
+            PngReader reader;
+            reader.open(input);
+            if (!reader.isInterlaced() && reader.isGreyscale()) {
+                writer.open(output, reader.getWidth(), reader.getHeight(),
+                        CONVERT_ROWS_PER_BLOCK);
+                std::vector<unsigned char> row(reader.getWidth());
+                for (int y = 0; y < reader.getHeight(); y++) {
+                    reader.readRow(&row[0]);
+                    writer.writeRow(&row[0]);
+                }
+                writer.close();
+                return;
+            }
+        }
+        if (isPgmSignature(signature, len) || isRawImagePath(input)) {
+            MappedImage mapped;
+            mapped.open(input);
+            writer.open(output, mapped.getWidth(), mapped.getHeight(),
+                    CONVERT_ROWS_PER_BLOCK);
+            for (int y = 0; y < mapped.getHeight(); y++) {
+                writer.writeRow(mapped.getRow(y));
+            }
+            writer.close();
+            return;
+        }
+        if (isTiffSignature(signature, len)) {
+            TiffReader reader;
+            reader.open(input);
+            if (reader.isStreamable()) {
+                int width = reader.getWidth();
+                int height = reader.getHeight();
+                int blockWidth = reader.getBlockWidth();
+                int blockHeight = reader.getBlockHeight();
+                writer.open(output, width, height, CONVERT_ROWS_PER_BLOCK);
+                std::vector<unsigned char> block;
+                std::vector<unsigned char> rows((std::size_t) blockHeight *
+                        width);
+                for (int y0 = 0; y0 < height; y0 += blockHeight) {
+                    int bandHeight = std::min(blockHeight, height - y0);
+                    for (int x0 = 0; x0 < width; x0 += blockWidth) {
+                        reader.readBlock(x0, y0, block);
+                        int bandWidth = std::min(blockWidth, width - x0);
+                        for (int y = 0; y < bandHeight; y++) {
+                            unsigned char *row =
+                                    &rows[(std::size_t) y * width];
+                            for (int x = 0; x < bandWidth; x++) {
+                                row[x0 + x] = reader.getPixel(block, x, y);
+                            }
+                        }
+                    }
+                    for (int y = 0; y < bandHeight; y++) {
+                        writer.writeRow(&rows[(std::size_t) y * width]);
+                    }
+                }
+                writer.close();
+                return;
+            }
+        }
+        typedef itk::Image<unsigned char, DIMENSION> ImageType;
+        ImageType::Pointer image = isRowBlockSignature(signature, len) ?
+                readRowBlockImage<ImageType>(input) :
+                readImage<ImageType>(input);
+        ImageType::SizeType size = image->GetLargestPossibleRegion()
+                .GetSize();
+        int width = size[0];
+        int height = size[1];
+        const unsigned char *buffer = image->GetBufferPointer();
+        writer.open(output, width, height, CONVERT_ROWS_PER_BLOCK);
+        for (int y = 0; y < height; y++) {
+            writer.writeRow(buffer + (std::size_t) y * width);
+        }
+        writer.close();
+    }
+}
+
+#endif	/* IMAGECONVERTER_HPP */
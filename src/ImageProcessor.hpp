@@ -0,0 +1,594 @@
+/*
+ * File:   ImageProcessor.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef IMAGEPROCESSOR_HPP
+#define	IMAGEPROCESSOR_HPP
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+
+#include "ImageUtils.hpp"
+#include "DeepZoomWriter.hpp"
+#include "MaskWriter.hpp"
+#include "OverlayPolicy.hpp"
+#include "OverlayRenderer.hpp"
+#include "PngReader.hpp"
+#include "ResultCache.hpp"
+#include "StageTimer.hpp"
+#include "StreamingSampler.hpp"
+
+namespace spc {
+
+    /**
+     * Stages of the per image pipeline, bits of ImageResult::stages
+     */
+    enum ImageStage {
+        STAGE_DECODE = 1, STAGE_SAMPLE = 2, STAGE_RENDER = 4,
+        STAGE_ENCODE = 8, STAGE_WRITE = 16
+    };
+
+    /**
+     * Counts for one image plus what it took to get them
+     */
+    struct ImageResult {
+        int gridWidth;
+        int gridHeight;
+        int positive;
+        int total;
+
+        /**
+         * Image size, 0 for a --cache hit that was not decoded
+         */
+        int width;
+        int height;
+
+        /**
+         * Bytes of the image read: the whole file when it was decoded whole,
+         * what the reader consumed when it was streamed
+         */
+        uint64_t bytesRead;
+
+        /**
+         * Bytes of masks and overlays written
+         */
+        uint64_t bytesWritten;
+
+        /**
+         * ImageStage bits of the stages that ran
+         */
+        int stages;
+
+        /**
+         * Microseconds spent in each stage.  Streamed images are decoded
+         * and sampled in one pass which is counted as decode.  Render is
+         * drawing masks and overlays, encode is compressing them and write
+         * is writing the compressed bytes to their files.
+         */
+        long long decodeMicros;
+        long long sampleMicros;
+        long long renderMicros;
+        long long encodeMicros;
+        long long writeMicros;
+    };
+
+    /**
+     * Settings shared by every image of a run
+     */
+    struct ProcessorSettings {
+
+        ProcessorSettings() : gridX(0), gridY(0), threshold(0),
+        pyramid(false), maskFormat(MASK_PNG), maxMemory(0) {
+        }
+
+        int gridX;
+        int gridY;
+        int threshold;
+
+        /**
+         * If not empty overlays are written to this directory
+         */
+        std::string saveImagesDir;
+
+        /**
+         * If true overlays are written as Deep Zoom pyramids
+         */
+        bool pyramid;
+
+        /**
+         * If not empty masks are written to this directory
+         */
+        std::string saveMasksDir;
+        MaskFormat maskFormat;
+
+        /**
+         * Limit in bytes on pixel buffers, 0 means no limit.  Images needing
+         * more than this to decode whole fail instead.
+         */
+        std::size_t maxMemory;
+    };
+
+    /**
+     * Runs the per image pipeline: decode, sample intersections and write
+     * whatever mask and overlay outputs are enabled.  When no mask or
+     * overlay can be needed PNG and TIFF images are sampled by streaming
+     * rows or tiles rather than decoding them whole.
+     */
+    class ImageProcessor {
+    public:
+        typedef unsigned char PixelType;
+        typedef itk::Image<PixelType, DIMENSION> ImageType;
+
+        /**
+         * @param settings
+         * @param policy decides which images get overlays, must outlive
+         *        this object
+         */
+        ImageProcessor(const ProcessorSettings& settings,
+                OverlayPolicy *policy) : _settings(settings), _policy(policy) {
+            RGBPixelType greenPixel;
+            greenPixel.SetRed(0);
+            greenPixel.SetBlue(0);
+            greenPixel.SetGreen(255);
+            RGBPixelType redPixel;
+            redPixel.SetRed(255);
+            redPixel.SetBlue(0);
+            redPixel.SetGreen(0);
+            _overlayPalette = createOverlayPalette(redPixel, greenPixel);
+        }
+
+        virtual ~ImageProcessor() {
+        }
+
+        const ProcessorSettings& getSettings() const {
+            return _settings;
+        }
+
+        /**
+         * Processes one image.  Throws itk::ExceptionObject or other
+         * std::exception upon failure.
+         * @param path image to process
+         * @param data if not NULL the PNG contents of path, which is then
+         *        not read
+         * @param cached if not NULL counts already known for image, image is
+         *        then only decoded if a mask or overlay is needed.  Ignored
+         *        if values is not NULL.
+         * @param result set to counts for image
+         * @param values if not NULL set to the value of every intersection
+         */
+        void process(const std::string& path,
+                const std::vector<unsigned char> *data,
+                const CachedResult *cached, ImageResult& result,
+                IntersectionValues *values = NULL) {
+            ImageType::Pointer image;
+            std::vector< std::pair<int, int> > positivePixels;
+            if (values != NULL) {
+                cached = NULL;
+            }
+            result.width = 0;
+            result.height = 0;
+            result.bytesRead = 0;
+            result.bytesWritten = 0;
+            result.stages = 0;
+            result.decodeMicros = 0;
+            result.sampleMicros = 0;
+            result.renderMicros = 0;
+            result.encodeMicros = 0;
+            result.writeMicros = 0;
+            std::chrono::steady_clock::time_point start =
+                    std::chrono::steady_clock::now();
+            StreamedImageInfo info;
+            if (cached != NULL) {
+                result.gridWidth = cached->gridWidth;
+                result.gridHeight = cached->gridHeight;
+                result.positive = cached->positive;
+                result.total = cached->total;
+            } else if (_settings.saveImagesDir.empty() &&
+                    _settings.saveMasksDir.empty() &&
+                    sampleIntersectionsStreaming(path, data, _settings.gridX,
+                    _settings.gridY, _settings.threshold, _settings.maxMemory,
+                    positivePixels, result.total, result.gridWidth,
+                    result.gridHeight, values, &info)) {
+                result.positive = positivePixels.size();
+                result.width = info.width;
+                result.height = info.height;
+                result.bytesRead = info.bytesRead;
+                result.decodeMicros = microsSince(start);
+                result.stages = STAGE_DECODE;
+            } else {
+                image = decode(path, data, result);
+                result.decodeMicros = microsSince(start);
+                result.stages = STAGE_DECODE | STAGE_SAMPLE;
+                start = std::chrono::steady_clock::now();
+                sample(image, result, positivePixels);
+                if (values != NULL) {
+                    getIntersectionValues<PixelType>(image, result.gridWidth,
+                            result.gridHeight, values->columns, values->rows,
+                            values->values);
+                }
+                result.sampleMicros = microsSince(start);
+            }
+
+            bool saveOverlay = !_settings.saveImagesDir.empty() &&
+                    _policy->select(path, result.positive, result.total);
+            if (!saveOverlay && _settings.saveMasksDir.empty()) {
+                return;
+            }
+            if (cached != NULL) {
+                start = std::chrono::steady_clock::now();
+                image = decode(path, data, result);
+                result.decodeMicros = microsSince(start);
+                start = std::chrono::steady_clock::now();
+                sample(image, result, positivePixels);
+                result.sampleMicros = microsSince(start);
+                result.stages = STAGE_DECODE | STAGE_SAMPLE;
+            }
+            // writes happen inside the encode laps of timer
+            WriteCounters &counters = getWriteCounters();
+            long long writeNanos = counters.nanos;
+            uint64_t bytesWritten = counters.bytes;
+            RowStageTimer timer;
+            if (!_settings.saveMasksDir.empty()) {
+                writeMask(path, image, &timer);
+            }
+            if (saveOverlay) {
+                writeOverlay(path, image, result, positivePixels, &timer);
+            }
+            result.writeMicros = (counters.nanos - writeNanos) / 1000;
+            result.bytesWritten = counters.bytes - bytesWritten;
+            result.renderMicros = timer.getRenderMicros();
+            result.encodeMicros = std::max(0LL,
+                    timer.getEncodeMicros() - result.writeMicros);
+            result.stages |= STAGE_RENDER | STAGE_ENCODE | STAGE_WRITE;
+        }
+
+    private:
+
+        /**
+         * Decodes image whole
+         * @param result width, height and bytesRead are set
+         */
+        ImageType::Pointer decode(const std::string& path,
+                const std::vector<unsigned char> *data, ImageResult& result) {
+            ImageType::Pointer image = decodeImage(path, data);
+            ImageType::SizeType size = image->GetLargestPossibleRegion()
+                    .GetSize();
+            result.width = size[0];
+            result.height = size[1];
+            struct stat st;
+            if (data != NULL) {
+                result.bytesRead = data->size();
+            } else if (stat(path.c_str(), &st) == 0) {
+                result.bytesRead = st.st_size;
+            }
+            return image;
+        }
+
+        ImageType::Pointer decodeImage(const std::string& path,
+                const std::vector<unsigned char> *data) {
+            int width;
+            int height;
+            if (_settings.maxMemory > 0 &&
+                readImageSize(path, data, width, height)) {
+                checkMemory((std::size_t) width * height, _settings.maxMemory,
+                        "Decoding whole image", path);
+            }
+            if (data == NULL) {
+                unsigned char signature[8];
+                std::size_t len = readSignature(path, data, signature,
+                        sizeof (signature));
+                if (isRowBlockSignature(signature, len)) {
+                    return readRowBlockImage<ImageType>(path);
+                }
+                if (isPgmSignature(signature, len) || isRawImagePath(path)) {
+                    return readMappedImage<ImageType>(path);
+                }
+                return readImage<ImageType>(path);
+            }
+            return readPngImage<ImageType>(data->empty() ? NULL : &(*data)[0],
+                    data->size(), path);
+        }
+
+        void sample(ImageType::Pointer const &image, ImageResult& result,
+                std::vector< std::pair<int, int> > &positivePixels) {
+            positivePixels = getIntersectionPixelsAboveThreshold<PixelType>(
+                    image, _settings.gridX, _settings.gridY,
+                    _settings.threshold, result.total, result.gridWidth,
+                    result.gridHeight);
+            result.positive = positivePixels.size();
+        }
+
+        /**
+         * @return file name of path for mask and overlay names, with any
+         *         extension other than .png replaced by .png as they are
+         *         always PNGs
+         */
+        static std::string getOutputName(const std::string& path) {
+            std::string name = getFileNameFromPath(path);
+            std::size_t dot = name.find_last_of(".");
+            if (dot == std::string::npos) {
+                return name + ".png";
+            }
+            if (strcasecmp(name.c_str() + dot, ".png") != 0) {
+                name.replace(dot, std::string::npos, ".png");
+            }
+            return name;
+        }
+
+        void writeMask(const std::string& path,
+                ImageType::Pointer const &image, RowStageTimer *timer) {
+            ImageType::SizeType size = image->GetLargestPossibleRegion()
+                    .GetSize();
+            std::string maskName = getOutputName(path);
+            if (_settings.maskFormat != MASK_PNG) {
+                std::size_t dot = maskName.find_last_of(".");
+                if (dot != std::string::npos) {
+                    maskName = maskName.substr(0, dot);
+                }
+                maskName += _settings.maskFormat == MASK_PBM ? ".pbm" :
+                        ".spm";
+            }
+            std::ostringstream os;
+            os << _settings.saveMasksDir << "/mask_thresh"
+                    << _settings.threshold << "." << maskName;
+            writeMaskImage(image->GetBufferPointer(), size[0], size[0],
+                    size[1], _settings.threshold, _settings.maskFormat,
+                    os.str(), timer);
+        }
+
+        void writeOverlay(const std::string& path,
+                ImageType::Pointer const &image, const ImageResult& result,
+                std::vector< std::pair<int, int> > const &positivePixels,
+                RowStageTimer *timer) {
+            std::ostringstream os;
+            os << _settings.saveImagesDir << "/grid" << _settings.gridX
+                    << "x" << _settings.gridY << "_pixel"
+                    << result.gridWidth << "x" << result.gridHeight
+                    << "_thresh" << _settings.threshold << "."
+                    << getOutputName(path);
+
+            ImageType::SizeType size = image->GetLargestPossibleRegion()
+                    .GetSize();
+            int width = size[0];
+            int height = size[1];
+            const unsigned char *source = image->GetBufferPointer();
+            OverlayRowRenderer renderer(width, height, result.gridWidth,
+                    result.gridHeight, positivePixels, 5);
+
+            if (!_settings.pyramid) {
+                writeOverlayImage(renderer, source, width, _overlayPalette,
+                        os.str(), timer);
+                return;
+            }
+            std::string base = os.str();
+            std::size_t dot = base.find_last_of(".");
+            if (dot != std::string::npos && dot > base.find_last_of("/")) {
+                base = base.substr(0, dot);
+            }
+            DeepZoomWriter pyramid(base, width, height);
+            std::vector<unsigned char> indexRow(width);
+            std::vector<unsigned char> rgbRow(3 * width);
+            for (int y = 0; y < height; y++) {
+                renderer.renderRGBRow(y, source + (std::size_t) y * width,
+                        _overlayPalette, &indexRow[0], &rgbRow[0]);
+                timer->rendered();
+                pyramid.addRow(&rgbRow[0]);
+                timer->encoded();
+            }
+            pyramid.close();
+            timer->encoded();
+        }
+
+        ProcessorSettings _settings;
+        OverlayPolicy *_policy;
+        std::vector<RGBPixelType> _overlayPalette;
+    };
+
+    /**
+     * Calls processor.process() catching any exception
+     * @param error set to exception message upon failure
+     * @param values if not NULL set to the value of every intersection
+     * @return false if processing failed
+     */
+    bool processImage(ImageProcessor& processor, const std::string& path,
+            const std::vector<unsigned char> *data, const CachedResult *cached,
+            ImageResult& result, std::string& error,
+            IntersectionValues *values = NULL) {
+        try {
+            processor.process(path, data, cached, result, values);
+            return true;
+        } catch (std::exception& e) {
+            error = singleLine(e.what());
+        } catch (...) {
+            error = "unknown error";
+        }
+        return false;
+    }
+
+    /**
+     * Reads len bytes from fd unless deadline passes first
+     * @param timedOut set to true if deadline passed
+     * @return number of bytes read, less than len upon timeout, error or
+     *         end of file
+     */
+    inline std::size_t readUntil(int fd, void *buffer, std::size_t len,
+            std::chrono::steady_clock::time_point deadline, bool &timedOut) {
+        std::size_t received = 0;
+        while (received < len) {
+            long remaining = std::chrono::duration_cast
+                    <std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0) {
+                timedOut = true;
+                break;
+            }
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            int rc = poll(&pfd, 1, remaining);
+            if (rc < 0 && errno == EINTR) {
+                continue;
+            }
+            if (rc <= 0) {
+                timedOut = rc == 0;
+                break;
+            }
+            ssize_t numRead = read(fd, (char *) buffer + received,
+                    len - received);
+            if (numRead < 0 && errno == EINTR) {
+                continue;
+            }
+            if (numRead <= 0) {
+                break;
+            }
+            received += numRead;
+        }
+        return received;
+    }
+
+    /**
+     * Runs processImage() in a child process that is killed if it takes
+     * longer than timeLimit seconds.  Also protects the run from crashes
+     * in decoders.  Files written by the child (masks, overlays) are kept,
+     * everything else must be done by the caller with the result.
+     *
+     * The child works on a copy of the overlay policy, so upon success the
+     * caller's policy is advanced with the result to stay in step.
+     * @param timeLimit seconds
+     * @param policy caller's overlay policy
+     * @param error set to reason upon failure
+     * @param values if not NULL set to the value of every intersection,
+     *        sent back by the child after its result
+     * @return false if processing failed or timed out
+     */
+    bool processImageInChild(ImageProcessor& processor,
+            const std::string& path, const std::vector<unsigned char> *data,
+            const CachedResult *cached, double timeLimit, OverlayPolicy *policy, ImageResult& result,
+            std::string& error, IntersectionValues *values = NULL) {
+        struct ChildReport {
+            int ok;
+            ImageResult result;
+            int columns;
+            int rows;
+            char error[1024];
+        };
+        int fds[2];
+        if (pipe(fds) != 0) {
+            error = std::string("pipe failed: ") + strerror(errno);
+            return false;
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            error = std::string("fork failed: ") + strerror(errno);
+            return false;
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            ChildReport report;
+            memset(&report, 0, sizeof (report));
+            std::string childError;
+            report.ok = processImage(processor, path, data, cached,
+                    report.result, childError, values);
+            strncpy(report.error, childError.c_str(),
+                    sizeof (report.error) - 1);
+            if (report.ok && values != NULL) {
+                report.columns = values->columns;
+                report.rows = values->rows;
+            }
+            bool sent = write(fds[1], &report, sizeof (report)) ==
+                    (ssize_t) sizeof (report);
+            const unsigned char *pending = report.ok && values != NULL &&
+                    !values->values.empty() ? &values->values[0] : NULL;
+            std::size_t left = pending == NULL ? 0 : values->values.size();
+            while (sent && left > 0) {
+                ssize_t numWritten = write(fds[1], pending, left);
+                if (numWritten < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (numWritten <= 0) {
+                    sent = false;
+                    break;
+                }
+                pending += numWritten;
+                left -= numWritten;
+            }
+            _exit(sent ? 0 : 1);
+        }
+        close(fds[1]);
+
+        ChildReport report;
+        bool timedOut = false;
+        std::chrono::steady_clock::time_point deadline =
+                std::chrono::steady_clock::now() +
+                std::chrono::microseconds((long long) (timeLimit * 1e6));
+        bool complete = readUntil(fds[0], &report, sizeof (report), deadline,
+                timedOut) == sizeof (report);
+        if (complete && report.ok && values != NULL) {
+            values->columns = report.columns;
+            values->rows = report.rows;
+            values->values.resize((std::size_t) report.columns * report.rows);
+            complete = values->values.empty() || readUntil(fds[0],
+                    &values->values[0], values->values.size(), deadline,
+                    timedOut) == values->values.size();
+        }
+        close(fds[0]);
+        if (!complete) {
+            kill(pid, SIGKILL);
+        }
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+        }
+
+        if (timedOut) {
+            std::ostringstream os;
+            os << "exceeded time limit of " << timeLimit << " seconds";
+            error = os.str();
+            return false;
+        }
+        if (!complete) {
+            std::ostringstream os;
+            if (WIFSIGNALED(status)) {
+                os << "terminated by signal " << WTERMSIG(status);
+            } else {
+                os << "exited with status " << WEXITSTATUS(status);
+            }
+            error = os.str();
+            return false;
+        }
+        if (!report.ok) {
+            report.error[sizeof (report.error) - 1] = '\0';
+            error = report.error;
+            return false;
+        }
+        result = report.result;
+        if (!processor.getSettings().saveImagesDir.empty()) {
+            policy->select(path, result.positive, result.total);
+        }
+        return true;
+    }
+}
+
+#endif	/* IMAGEPROCESSOR_HPP */
@@ -0,0 +1,227 @@
+/*
+ * File:   ImageSource.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef IMAGESOURCE_HPP
+#define	IMAGESOURCE_HPP
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace spc {
+
+    /**
+     * Waits until fd has input or *stop is set.  SIGINT and SIGTERM, whose
+     * handler sets *stop, are blocked from checking *stop until the wait
+     * starts so one arriving in between still ends the wait.
+     * @param stop intended to be set from a signal handler
+     * @return true if fd has input (or hit end of file or an error),
+     *         false once *stop is set
+     */
+    inline bool waitForInput(int fd, volatile sig_atomic_t *stop) {
+        sigset_t blocked;
+        sigset_t previous;
+        sigemptyset(&blocked);
+        sigaddset(&blocked, SIGINT);
+        sigaddset(&blocked, SIGTERM);
+        sigprocmask(SIG_BLOCK, &blocked, &previous);
+        int rc = -1;
+        while (!*stop) {
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+#ifdef __linux__
+            rc = ppoll(&pfd, 1, NULL, &previous);
+#else
+            // without ppoll a signal just before poll() is only noticed
+            // once input arrives
+            sigprocmask(SIG_SETMASK, &previous, NULL);
+            rc = poll(&pfd, 1, -1);
+            sigprocmask(SIG_BLOCK, &blocked, NULL);
+#endif
+            if (rc >= 0 || errno != EINTR) {
+                break;
+            }
+        }
+        bool ready = !*stop && rc != 0;
+        sigprocmask(SIG_SETMASK, &previous, NULL);
+        return ready;
+    }
+
+    /**
+     * Supplies paths of images to process, one at a time, in processing
+     * order.
+     */
+    class ImageSource {
+    public:
+
+        virtual ~ImageSource() {
+        }
+
+        /**
+         * Gets next image
+         * @param path set to path of next image
+         * @return false when there are no more images
+         */
+        virtual bool next(std::string& path) = 0;
+
+        /**
+         * Gets next image like next() for a caller that will not use it,
+         * sources that load images in next() skip their contents
+         * @param path set to path of next image
+         * @return false when there are no more images
+         */
+        virtual bool skipNext(std::string& path) {
+            return next(path);
+        }
+
+        /**
+         * Contents of the image last returned by next() for sources that
+         * hold images in memory
+         * @return NULL if the image should be read from its path
+         */
+        virtual const std::vector<unsigned char> *getData() const {
+            return NULL;
+        }
+    };
+
+    /**
+     * ImageSource over a list that is already in memory
+     */
+    class ListImageSource : public ImageSource {
+    public:
+
+        ListImageSource(const std::vector<std::string>& paths) :
+        _paths(paths), _index(0) {
+        }
+
+        virtual bool next(std::string& path) {
+            if (_index >= _paths.size()) {
+                return false;
+            }
+            path = _paths[_index++];
+            return true;
+        }
+
+    private:
+        std::vector<std::string> _paths;
+        std::size_t _index;
+    };
+
+    /**
+     * ImageSource reading one path per line from a file descriptor as
+     * images are requested, so the producer writing the stream and the
+     * counting overlap and the path list never has to fit in memory.
+     * Blank lines and lines starting with # are skipped.  Waiting for the
+     * producer ends when stop is set, so a signal stops a run blocked on
+     * a pipe or FIFO.
+     */
+    class StreamImageSource : public ImageSource {
+    public:
+
+        /**
+         * @param fd descriptor to read, left open
+         * @param stop next() returns false once this is nonzero, intended
+         *        to be set from a signal handler
+         */
+        StreamImageSource(int fd, volatile sig_atomic_t *stop) : _fd(fd),
+        _ownFd(false), _stop(stop), _start(0), _eof(false) {
+        }
+
+        /**
+         * @param manifest path of file to read, a FIFO is opened without
+         *        waiting for its writer, next() waits instead
+         * @param stop next() returns false once this is nonzero
+         */
+        StreamImageSource(const std::string& manifest,
+                volatile sig_atomic_t *stop) : _fd(-1), _ownFd(true),
+        _stop(stop), _start(0), _eof(false) {
+            _fd = open(manifest.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if (_fd >= 0) {
+                fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) & ~O_NONBLOCK);
+            }
+        }
+
+        virtual ~StreamImageSource() {
+            if (_ownFd && _fd >= 0) {
+                close(_fd);
+            }
+        }
+
+        bool isOpen() const {
+            return _fd >= 0;
+        }
+
+        virtual bool next(std::string& path) {
+            while (true) {
+                std::size_t end = _buffer.find('\n', _start);
+                if (end == std::string::npos) {
+                    if (readMore()) {
+                        continue;
+                    }
+                    if (!_eof || _start >= _buffer.size()) {
+                        return false;
+                    }
+                    // last line without newline
+                    end = _buffer.size();
+                }
+                path.assign(_buffer, _start, end - _start);
+                _start = end + 1;
+                if (!path.empty() && path[path.length() - 1] == '\r') {
+                    path.erase(path.length() - 1);
+                }
+                if (!path.empty() && path[0] != '#') {
+                    return true;
+                }
+            }
+        }
+
+    private:
+        StreamImageSource(const StreamImageSource& orig);
+        StreamImageSource& operator=(const StreamImageSource& orig);
+
+        /**
+         * Appends the next chunk of input to _buffer, dropping lines
+         * already returned
+         * @return false at end of input, on error or once stop is set
+         */
+        bool readMore() {
+            if (_eof || _fd < 0) {
+                return false;
+            }
+            _buffer.erase(0, std::min(_start, _buffer.size()));
+            _start = 0;
+            char chunk[64 * 1024];
+            while (waitForInput(_fd, _stop)) {
+                ssize_t numRead = read(_fd, chunk, sizeof (chunk));
+                if (numRead > 0) {
+                    _buffer.append(chunk, numRead);
+                    return true;
+                }
+                if (numRead == 0 || errno != EINTR) {
+                    _eof = true;
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        int _fd;
+        bool _ownFd;
+        volatile sig_atomic_t *_stop;
+        std::string _buffer;
+        std::size_t _start;
+        bool _eof;
+    };
+}
+
+#endif	/* IMAGESOURCE_HPP */
@@ -9,14 +9,23 @@
 #define	IMAGEUTILS_HPP
 
 #include <math.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "itkImage.h"
 #include "itkIndex.h"
 #include "itkCastImageFilter.h"
 #include "itkImageDuplicator.h"
 
+#include "DirectoryScanner.hpp"
+#include "IntersectionValues.hpp"
+
 
 namespace spc {
 
@@ -58,41 +67,25 @@ namespace spc {
     /**
      * Return list of png files in directory passed in
      * @param directory
-     * @return 
+     * @return full paths sorted in byte order
      */
     std::vector<std::string> getImageFileNamesInDir(const std::string& directory) {
-
-        std::string pngSuffix = ".png";
-        std::size_t suffixLen = pngSuffix.length();
-        std::vector<std::string> fileNames;
-        struct dirent *dirEnt;
-        DIR *dir = opendir(directory.c_str());
-        if (dir == NULL) {
-            return fileNames;
-        }
-        while ((dirEnt = readdir(dir)) != NULL) {
-            std::string entry = dirEnt->d_name;
-            if (entry.length() < suffixLen) {
-                continue;
-            }
-            std::string ending = entry.substr(entry.length() - suffixLen, suffixLen);
-            if (ending.compare(pngSuffix) == 0) {
-                fileNames.push_back(directory + "/" + entry);
-            }
-        }
-        return fileNames;
+        return scanDirectory(directory, ScanOptions());
     }
 
     /**
      * Returns a list of images from path specified by <b>arg</b> parameter
      * @param arg either a directory or a path to a single image
-     * @return If <b>arg</b> is a directory then a list of full path png files in 
-     *         the directory will be returned. Else just the value of <b>arg</b>
-     *         will be returned.
+     * @param options controls recursion and file name patterns used when
+     *        <b>arg</b> is a directory
+     * @return If <b>arg</b> is a directory then a sorted list of full path
+     *         files in the directory matching options will be returned.
+     *         Else just the value of <b>arg</b> will be returned.
      */
-    std::vector<std::string> getImages(const std::string& arg) {
+    std::vector<std::string> getImages(const std::string& arg,
+            const ScanOptions& options = ScanOptions()) {
         if (is_dir(arg.c_str())) {
-            return getImageFileNamesInDir(arg);
+            return scanDirectory(arg, options);
         }
         std::vector<std::string> imageFile;
         imageFile.push_back(arg);
@@ -194,7 +187,53 @@ namespace spc {
         castFilter->Update();
         return castFilter->GetOutput();
     }
-    
+
+    /**
+     * Palette index reserved for grid lines
+     */
+    const unsigned char PALETTE_GRID_INDEX = 0;
+
+    /**
+     * Palette index reserved for circles marking positive intersections
+     */
+    const unsigned char PALETTE_MARKER_INDEX = 1;
+
+    /**
+     * First palette index used for grey values.  Greys are quantized into
+     * the remaining entries at the top of the palette.
+     */
+    const int PALETTE_GREY_START = 2;
+    const int PALETTE_GREY_LEVELS = 256 - PALETTE_GREY_START;
+
+    /**
+     * Maps an 8-bit grey value to its palette index
+     * @param grey
+     * @return index in range PALETTE_GREY_START - 255
+     */
+    inline unsigned char greyToPaletteIndex(unsigned char grey) {
+        return PALETTE_GREY_START +
+                (grey * (PALETTE_GREY_LEVELS - 1) + 127) / 255;
+    }
+
+    /**
+     * Builds the 256 entry overlay palette
+     * @param gridPixel color for PALETTE_GRID_INDEX
+     * @param markerPixel color for PALETTE_MARKER_INDEX
+     * @return palette, index i holds the color for palette index i
+     */
+    std::vector<RGBPixelType> createOverlayPalette(RGBPixelType gridPixel,
+            RGBPixelType markerPixel) {
+        std::vector<RGBPixelType> palette(256);
+        palette[PALETTE_GRID_INDEX] = gridPixel;
+        palette[PALETTE_MARKER_INDEX] = markerPixel;
+        for (int i = 0; i < PALETTE_GREY_LEVELS; i++) {
+            unsigned char grey = (i * 255 + (PALETTE_GREY_LEVELS - 1) / 2) /
+                    (PALETTE_GREY_LEVELS - 1);
+            palette[PALETTE_GREY_START + i].Fill(grey);
+        }
+        return palette;
+    }
+
     /**
      * Draws a grid on image using pixel passed in.  Note this implementation
      * omits the pixels at the intersections and +-1 pixel around those
@@ -306,6 +345,161 @@ namespace spc {
         return image;
     }
 
+    /**
+     * Flattens exception message onto one line so it fits in one error
+     * record
+     */
+    inline std::string singleLine(const std::string& msg) {
+        std::string line = msg;
+        for (std::size_t i = 0; i < line.length(); i++) {
+            if (line[i] == '\n' || line[i] == '\r') {
+                line[i] = ' ';
+            }
+        }
+        return line;
+    }
+
+    /**
+     * Reverses order of bits in byte
+     * @param b
+     * @return b with bit 0 swapped with bit 7, bit 1 with bit 6 and so on
+     */
+    inline unsigned char reverseBits(unsigned char b) {
+        return ((b * 0x0802LU & 0x22110LU) |
+                (b * 0x8020LU & 0x88440LU)) * 0x10101LU >> 16;
+    }
+
+    /**
+     * Thresholds a row of 8-bit pixels and packs the result 8 pixels per
+     * byte, most significant bit first (the PNG 1-bit and PBM layout).  A
+     * pixel's bit is set if pixel >= threshold.  Unused bits in the last
+     * byte are zero.  Uses SSE2 when available.
+     * @param source row of width 8-bit pixels
+     * @param width number of pixels in row
+     * @param threshold
+     * @param dest buffer of (width + 7) / 8 bytes
+     */
+    inline void thresholdAndPackRow(const unsigned char *source, int width,
+            int threshold, unsigned char *dest) {
+        int numBytes = (width + 7) / 8;
+        if (threshold > 255) {
+            memset(dest, 0, numBytes);
+            return;
+        }
+        if (threshold < 0) {
+            threshold = 0;
+        }
+        int x = 0;
+#ifdef __SSE2__
+        __m128i thresh = _mm_set1_epi8((char) threshold);
+        for (; x + 16 <= width; x += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (source + x));
+            // unsigned v >= thresh  <=>  max(v, thresh) == v
+            __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(v, thresh), v);
+            int bits = _mm_movemask_epi8(ge);
+            dest[x / 8] = reverseBits(bits & 0xff);
+            dest[x / 8 + 1] = reverseBits((bits >> 8) & 0xff);
+        }
+#endif
+        for (; x < width; x += 8) {
+            unsigned char byte = 0;
+            int end = x + 8 < width ? x + 8 : width;
+            for (int i = x; i < end; i++) {
+                if (source[i] >= threshold) {
+                    byte |= 0x80 >> (i - x);
+                }
+            }
+            dest[x / 8] = byte;
+        }
+    }
+
+    /**
+     * Counts set bits
+     * @param data n bytes
+     * @param n number of bytes
+     * @return number of bits set in data
+     */
+    inline std::size_t popcountBytes(const unsigned char *data,
+            std::size_t n) {
+        std::size_t count = 0;
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof (word));
+            count += __builtin_popcountll(word);
+        }
+        for (; i < n; i++) {
+            count += __builtin_popcount(data[i]);
+        }
+        return count;
+    }
+
+    /**
+     * Counts bits set in both a and b
+     * @param a n bytes
+     * @param b n bytes
+     * @param n number of bytes
+     * @return number of bits set in a & b
+     */
+    inline std::size_t popcountAnd(const unsigned char *a,
+            const unsigned char *b, std::size_t n) {
+        std::size_t count = 0;
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t wordA;
+            uint64_t wordB;
+            memcpy(&wordA, a + i, sizeof (wordA));
+            memcpy(&wordB, b + i, sizeof (wordB));
+            count += __builtin_popcountll(wordA & wordB);
+        }
+        for (; i < n; i++) {
+            count += __builtin_popcount(a[i] & b[i]);
+        }
+        return count;
+    }
+
+    /**
+     * Counts values >= threshold.  Uses SSE2 when available, which keeps
+     * up with memory bandwidth.
+     * @param values n 8-bit values
+     * @param n number of values
+     * @param threshold
+     * @return number of values >= threshold
+     */
+    inline std::size_t countAtOrAboveThreshold(const unsigned char *values,
+            std::size_t n, int threshold) {
+        if (threshold > 255) {
+            return 0;
+        }
+        if (threshold <= 0) {
+            return n;
+        }
+        std::size_t count = 0;
+        std::size_t i = 0;
+#ifdef __SSE2__
+        __m128i thresh = _mm_set1_epi8((char) threshold);
+        __m128i zero = _mm_setzero_si128();
+        while (i + 16 <= n) {
+            // byte counters are folded into 64-bit sums before they can
+            // overflow
+            __m128i counts = _mm_setzero_si128();
+            std::size_t end = i + 255 * 16 < n ? i + 255 * 16 : n;
+            for (; i + 16 <= end; i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *) (values + i));
+                __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(v, thresh), v);
+                counts = _mm_sub_epi8(counts, ge);
+            }
+            __m128i sums = _mm_sad_epu8(counts, zero);
+            count += _mm_cvtsi128_si32(sums) +
+                    _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+        }
+#endif
+        for (; i < n; i++) {
+            count += values[i] >= threshold;
+        }
+        return count;
+    }
+
     /**
      * First generates a grid across image with gridx vertical grid lines and
      * gridy horizontal grid lines.  Function then examines intersections
@@ -361,6 +555,43 @@ namespace spc {
         }
         return positivePixels;
     }
+
+    /**
+     * Copies the pixel value at every grid intersection used by
+     * getIntersectionPixelsAboveThreshold, row by row starting with the
+     * intersection at (grid_width,grid_height)
+     *
+     * @param image the image being examined.  Should be a 8-bit greyscale image
+     * @param grid_width vertical grid spacing in pixels
+     * @param grid_height horizontal grid spacing in pixels
+     * @param columns set to number of intersections in each grid row
+     * @param rows set to number of grid rows
+     * @param values set to columns * rows intersection values
+     */
+    template<typename TPixelType>
+    void getIntersectionValues
+    (typename itk::Image<TPixelType,spc::DIMENSION>::Pointer const &image,
+            int grid_width,int grid_height,int &columns,int &rows,
+            std::vector<unsigned char> &values){
+        typename itk::Image<TPixelType,spc::DIMENSION>::SizeType size =
+                image->GetLargestPossibleRegion().GetSize();
+        int image_width = size[0];
+        int image_height = size[1];
+        columns = gridLineCount(image_width,grid_width);
+        rows = gridLineCount(image_height,grid_height);
+        values.clear();
+        if (columns == 0 || rows == 0) {
+            return;
+        }
+        values.reserve((std::size_t) columns * rows);
+        const TPixelType *buffer = image->GetBufferPointer();
+        for (int y = grid_height; y < image_height; y += grid_height) {
+            const TPixelType *row = buffer + (std::size_t) y * image_width;
+            for (int x = grid_width; x < image_width; x += grid_width) {
+                values.push_back(row[x]);
+            }
+        }
+    }
     
 }
 
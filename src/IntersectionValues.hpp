@@ -0,0 +1,412 @@
+/*
+ * File:   IntersectionValues.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef INTERSECTIONVALUES_HPP
+#define	INTERSECTIONVALUES_HPP
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <string>
+#include <vector>
+
+namespace spc {
+
+    /**
+     * @return number of grid lines at multiples of spacing greater than 0
+     *         and less than size
+     */
+    inline int gridLineCount(int size, int spacing) {
+        return spacing > 0 && size > 0 ? (size - 1) / spacing : 0;
+    }
+
+    /**
+     * Pixel value at every grid intersection of one image.  The grid is
+     * implicit: value (column c, row r) is the pixel at
+     * x = (c + 1) * gridWidth, y = (r + 1) * gridHeight and values are
+     * stored row by row.
+     */
+    struct IntersectionValues {
+
+        IntersectionValues() : columns(0), rows(0) {
+        }
+
+        int columns;
+        int rows;
+        std::vector<unsigned char> values;
+    };
+
+    /**
+     * Header at offset 0 of an intersection values file
+     */
+    struct IntersectionFileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrderMark;
+    };
+
+    /**
+     * Header of one image's record, followed by pathBytes bytes of path,
+     * columns * rows bytes of values and zeros up to a multiple of 8 bytes
+     */
+    struct IntersectionRecordHeader {
+        uint32_t pathBytes;
+        uint32_t columns;
+        uint32_t rows;
+        int32_t gridX;
+        int32_t gridY;
+        int32_t gridWidth;
+        int32_t gridHeight;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof (IntersectionFileHeader) == 16,
+            "header must be packed");
+    static_assert(sizeof (IntersectionRecordHeader) == 32,
+            "record header must be packed");
+
+    const char INTERSECTION_MAGIC[8] = {'S', 'P', 'C', 'V', 'A', 'L', 'S',
+        '\0'};
+    const uint32_t INTERSECTION_BYTE_ORDER_MARK = 0x01020304;
+
+    /**
+     * @return size of record in bytes including its header and padding
+     */
+    inline uint64_t intersectionRecordBytes(
+            const IntersectionRecordHeader &header) {
+        uint64_t bytes = sizeof (header) + (uint64_t) header.pathBytes +
+                (uint64_t) header.columns * header.rows;
+        return (bytes + 7) / 8 * 8;
+    }
+
+    /**
+     * Appends per image intersection values to <path> and the offset of
+     * each record as a uint64 to <path>.index, so record i can be found
+     * without reading the records before it.  A record is only added to
+     * the index after it has been written, and open() in append mode drops
+     * a record left incomplete by a killed run.  All values are in native
+     * (little endian) byte order.
+     */
+    class IntersectionValueWriter {
+    public:
+
+        IntersectionValueWriter() : _fd(-1), _indexFd(-1), _end(0),
+        _indexEnd(0) {
+        }
+
+        virtual ~IntersectionValueWriter() {
+            close();
+        }
+
+        /**
+         * @param append if true records are added to an existing file,
+         *        otherwise any existing file is replaced
+         * @param error set to reason upon failure
+         * @return false upon failure
+         */
+        bool open(const std::string& path, bool append, std::string& error) {
+            int flags = O_RDWR | O_CREAT | O_CLOEXEC | (append ? 0 : O_TRUNC);
+            _fd = ::open(path.c_str(), flags, 0644);
+            _indexFd = ::open((path + ".index").c_str(), flags, 0644);
+            if (_fd < 0 || _indexFd < 0) {
+                error = strerror(errno);
+                return false;
+            }
+            struct stat st;
+            if (fstat(_fd, &st) != 0) {
+                error = strerror(errno);
+                return false;
+            }
+            if (st.st_size == 0) {
+                IntersectionFileHeader header;
+                memset(&header, 0, sizeof (header));
+                memcpy(header.magic, INTERSECTION_MAGIC, sizeof (header.magic));
+                header.version = 1;
+                header.byteOrderMark = INTERSECTION_BYTE_ORDER_MARK;
+                if (pwrite(_fd, &header, sizeof (header), 0) !=
+                    (ssize_t) sizeof (header) || ftruncate(_indexFd, 0) != 0) {
+                    error = strerror(errno);
+                    return false;
+                }
+                _end = sizeof (header);
+                _indexEnd = 0;
+                return true;
+            }
+            return recover(st.st_size, error);
+        }
+
+        /**
+         * Appends one image's values
+         * @return false if write failed
+         */
+        bool add(const std::string& path, int gridX, int gridY,
+                int gridWidth, int gridHeight,
+                const IntersectionValues& values) {
+            IntersectionRecordHeader header;
+            memset(&header, 0, sizeof (header));
+            header.pathBytes = path.size();
+            header.columns = values.columns;
+            header.rows = values.rows;
+            header.gridX = gridX;
+            header.gridY = gridY;
+            header.gridWidth = gridWidth;
+            header.gridHeight = gridHeight;
+            if (values.values.size() != (std::size_t) values.columns *
+                values.rows) {
+                return false;
+            }
+            static const char zeros[8] = {0};
+            uint64_t bytes = intersectionRecordBytes(header);
+            struct iovec parts[4];
+            parts[0].iov_base = &header;
+            parts[0].iov_len = sizeof (header);
+            parts[1].iov_base = (void *) path.data();
+            parts[1].iov_len = path.size();
+            parts[2].iov_base = (void *) (values.values.empty() ? NULL :
+                    &values.values[0]);
+            parts[2].iov_len = values.values.size();
+            parts[3].iov_base = (void *) zeros;
+            parts[3].iov_len = bytes - sizeof (header) - path.size() -
+                    values.values.size();
+            uint64_t offset = _end;
+            if (!writeFully(_fd, parts, 4, offset)) {
+                return false;
+            }
+            _end = offset + bytes;
+            struct iovec entry;
+            entry.iov_base = &offset;
+            entry.iov_len = sizeof (offset);
+            if (!writeFully(_indexFd, &entry, 1, _indexEnd)) {
+                return false;
+            }
+            _indexEnd += sizeof (offset);
+            return true;
+        }
+
+        /**
+         * @return false if closing either file failed
+         */
+        bool close() {
+            bool ok = true;
+            if (_fd >= 0) {
+                ok = ::close(_fd) == 0;
+            }
+            if (_indexFd >= 0) {
+                ok = ::close(_indexFd) == 0 && ok;
+            }
+            _fd = -1;
+            _indexFd = -1;
+            return ok;
+        }
+
+    private:
+        IntersectionValueWriter(const IntersectionValueWriter& orig);
+        IntersectionValueWriter& operator=(const IntersectionValueWriter&
+        orig);
+
+        /**
+         * Drops index entries whose record is incomplete and anything after
+         * the last complete record
+         */
+        bool recover(uint64_t size, std::string& error) {
+            IntersectionFileHeader header;
+            if (pread(_fd, &header, sizeof (header), 0) !=
+                (ssize_t) sizeof (header) ||
+                memcmp(header.magic, INTERSECTION_MAGIC, 8) != 0 ||
+                header.version != 1 ||
+                header.byteOrderMark != INTERSECTION_BYTE_ORDER_MARK) {
+                error = "not an intersection values file or wrong byte order";
+                return false;
+            }
+            struct stat st;
+            if (fstat(_indexFd, &st) != 0) {
+                error = strerror(errno);
+                return false;
+            }
+            uint64_t entries = st.st_size / sizeof (uint64_t);
+            _end = sizeof (header);
+            while (entries > 0) {
+                uint64_t offset;
+                IntersectionRecordHeader record;
+                if (pread(_indexFd, &offset, sizeof (offset),
+                    (entries - 1) * sizeof (offset)) ==
+                    (ssize_t) sizeof (offset) &&
+                    offset >= sizeof (header) &&
+                    pread(_fd, &record, sizeof (record), offset) ==
+                    (ssize_t) sizeof (record) &&
+                    offset + intersectionRecordBytes(record) <= size) {
+                    _end = offset + intersectionRecordBytes(record);
+                    break;
+                }
+                entries--;
+            }
+            _indexEnd = entries * sizeof (uint64_t);
+            if (ftruncate(_fd, _end) != 0 ||
+                ftruncate(_indexFd, _indexEnd) != 0) {
+                error = strerror(errno);
+                return false;
+            }
+            return true;
+        }
+
+        bool writeFully(int fd, struct iovec *parts, int count,
+                uint64_t offset) {
+            while (count > 0) {
+                ssize_t numWritten = pwritev(fd, parts, count, offset);
+                if (numWritten < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (numWritten <= 0) {
+                    return false;
+                }
+                offset += numWritten;
+                while (count > 0 && (std::size_t) numWritten >=
+                        parts->iov_len) {
+                    numWritten -= parts->iov_len;
+                    parts++;
+                    count--;
+                }
+                if (count > 0) {
+                    parts->iov_base = (char *) parts->iov_base + numWritten;
+                    parts->iov_len -= numWritten;
+                }
+            }
+            return true;
+        }
+
+        int _fd;
+        int _indexFd;
+        uint64_t _end;
+        uint64_t _indexEnd;
+    };
+
+    /**
+     * One image's record as mapped by IntersectionValueReader
+     */
+    struct IntersectionRecord {
+        const IntersectionRecordHeader *header;
+        const char *path;
+        const unsigned char *values;
+    };
+
+    /**
+     * Memory maps a file written by IntersectionValueWriter and its index.
+     * Every record is bounds checked once by open(), after that records
+     * are handed out in place.
+     */
+    class IntersectionValueReader {
+    public:
+
+        IntersectionValueReader() : _map(NULL), _mapBytes(0),
+        _indexMap(NULL), _indexBytes(0), _offsets(NULL), _numRecords(0) {
+        }
+
+        virtual ~IntersectionValueReader() {
+            if (_map != NULL) {
+                munmap(_map, _mapBytes);
+            }
+            if (_indexMap != NULL) {
+                munmap(_indexMap, _indexBytes);
+            }
+        }
+
+        /**
+         * @param error set to reason upon failure
+         * @return false if files could not be mapped or are not valid
+         */
+        bool open(const std::string& path, std::string& error) {
+            if (!mapFile(path, _map, _mapBytes, error) ||
+                !mapFile(path + ".index", _indexMap, _indexBytes, error)) {
+                return false;
+            }
+            const IntersectionFileHeader *header =
+                    (const IntersectionFileHeader *) _map;
+            if (_mapBytes < sizeof (*header) ||
+                memcmp(header->magic, INTERSECTION_MAGIC, 8) != 0 ||
+                header->version != 1 ||
+                header->byteOrderMark != INTERSECTION_BYTE_ORDER_MARK) {
+                error = "not an intersection values file or wrong byte order";
+                return false;
+            }
+            _offsets = (const uint64_t *) _indexMap;
+            _numRecords = _indexBytes / sizeof (uint64_t);
+            for (std::size_t i = 0; i < _numRecords; i++) {
+                uint64_t offset = _offsets[i];
+                if (offset < sizeof (*header) || offset % 8 != 0 ||
+                    offset > _mapBytes ||
+                    _mapBytes - offset < sizeof (IntersectionRecordHeader) ||
+                    intersectionRecordBytes(*(const IntersectionRecordHeader *)
+                    ((const char *) _map + offset)) > _mapBytes - offset) {
+                    error = "intersection values file is truncated or does "
+                            "not match its index";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::size_t getNumRecords() const {
+            return _numRecords;
+        }
+
+        IntersectionRecord getRecord(std::size_t i) const {
+            IntersectionRecord record;
+            const char *start = (const char *) _map + _offsets[i];
+            record.header = (const IntersectionRecordHeader *) start;
+            record.path = start + sizeof (IntersectionRecordHeader);
+            record.values = (const unsigned char *) record.path +
+                    record.header->pathBytes;
+            return record;
+        }
+
+    private:
+        IntersectionValueReader(const IntersectionValueReader& orig);
+        IntersectionValueReader& operator=(const IntersectionValueReader&
+        orig);
+
+        static bool mapFile(const std::string& path, void *&map,
+                std::size_t &bytes, std::string& error) {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0) {
+                error = path + ": " + strerror(errno);
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                return false;
+            }
+            bytes = st.st_size;
+            if (bytes == 0) {
+                ::close(fd);
+                return true;
+            }
+            map = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (map == MAP_FAILED) {
+                map = NULL;
+                error = path + ": " + strerror(errno);
+                return false;
+            }
+            return true;
+        }
+
+        void *_map;
+        std::size_t _mapBytes;
+        void *_indexMap;
+        std::size_t _indexBytes;
+        const uint64_t *_offsets;
+        std::size_t _numRecords;
+    };
+}
+
+#endif	/* INTERSECTIONVALUES_HPP */
@@ -0,0 +1,83 @@
+/*
+ * File:   JsonLines.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef JSONLINES_HPP
+#define	JSONLINES_HPP
+
+#include <string>
+
+#include "ImageProcessor.hpp"
+#include "OutputBuffer.hpp"
+
+namespace spc {
+
+    /**
+     * Appends the --outputformat jsonl record of one image to line, e.g.
+     *
+     *     {"type":"image","image":"a.png","source":"image","worker":0,
+     *     "width":1503,"height":997,"gridX":5,"gridY":4,"gridWidth":300,
+     *     "gridHeight":249,"positive":12,"total":20,"bytesRead":1501569,
+     *     "bytesWritten":0,"micros":{"decode":9120,"sample":0,"render":0,
+     *     "encode":0,"write":0}}
+     *
+     * all on one line.  Nothing is allocated once line has grown to the
+     * longest record.
+     * @param source image if the image was read, cache for a --cache hit,
+     *        checkpoint for a row repeated from --checkpoint
+     * @param worker --shard index of the run
+     */
+    inline void appendImageRecord(LineBuilder& line, const std::string& path,
+            const char *source, int worker, int gridX, int gridY,
+            const ImageResult& result) {
+        line.append("{\"type\":\"image\",\"image\":")
+                .appendJsonString(path)
+                .append(",\"source\":\"").append(source)
+                .append("\",\"worker\":").append(worker)
+                .append(",\"width\":").append(result.width)
+                .append(",\"height\":").append(result.height)
+                .append(",\"gridX\":").append(gridX)
+                .append(",\"gridY\":").append(gridY)
+                .append(",\"gridWidth\":").append(result.gridWidth)
+                .append(",\"gridHeight\":").append(result.gridHeight)
+                .append(",\"positive\":").append(result.positive)
+                .append(",\"total\":").append(result.total)
+                .append(",\"bytesRead\":").append((long long) result.bytesRead)
+                .append(",\"bytesWritten\":")
+                .append((long long) result.bytesWritten)
+                .append(",\"micros\":{\"decode\":").append(result.decodeMicros)
+                .append(",\"sample\":").append(result.sampleMicros)
+                .append(",\"render\":").append(result.renderMicros)
+                .append(",\"encode\":").append(result.encodeMicros)
+                .append(",\"write\":").append(result.writeMicros)
+                .append("}}");
+    }
+
+    /**
+     * Appends the --outputformat jsonl record of an image that failed
+     */
+    inline void appendErrorRecord(LineBuilder& line, const std::string& path,
+            int worker, const std::string& reason) {
+        line.append("{\"type\":\"error\",\"image\":")
+                .appendJsonString(path)
+                .append(",\"worker\":").append(worker)
+                .append(",\"reason\":").appendJsonString(reason)
+                .append('}');
+    }
+
+    /**
+     * Appends the --outputformat jsonl record holding the run's summary
+     */
+    inline void appendSummaryRecord(LineBuilder& line, double seconds,
+            long long totalPositive, long long total, int failedImages) {
+        line.append("{\"type\":\"summary\",\"seconds\":").append(seconds)
+                .append(",\"grandTotalPositive\":").append(totalPositive)
+                .append(",\"grandTotal\":").append(total)
+                .append(",\"failedImages\":").append(failedImages)
+                .append('}');
+    }
+}
+
+#endif	/* JSONLINES_HPP */
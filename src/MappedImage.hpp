@@ -0,0 +1,299 @@
+/*
+ * File:   MappedImage.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef MAPPEDIMAGE_HPP
+#define	MAPPEDIMAGE_HPP
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "itkImage.h"
+
+namespace spc {
+
+    /**
+     * @return true if data starts with a binary PGM (P5) signature
+     */
+    inline bool isPgmSignature(const unsigned char *data, std::size_t size) {
+        return size >= 3 && data[0] == 'P' && data[1] == '5' &&
+                isspace(data[2]);
+    }
+
+    /**
+     * @return true if path has the .u8 extension of raw images
+     */
+    inline bool isRawImagePath(const std::string& path) {
+        return path.size() > 3 &&
+                path.compare(path.size() - 3, 3, ".u8") == 0;
+    }
+
+    /**
+     * Memory maps an uncompressed 8-bit greyscale image, either a binary
+     * PGM or a raw .u8 file of rows described by a <file>.hdr sidecar.
+     * Rows are handed out as pointers into the mapping, nothing is copied
+     * and, as read ahead is turned off, only pages holding rows that are
+     * read get faulted in.
+     *
+     * The sidecar holds one "key value" pair per line, # starts a comment:
+     *
+     *     width 2048
+     *     height 2048
+     *     offset 0      (optional, bytes before the first row)
+     *     stride 2048   (optional, bytes between row starts, default width)
+     *
+     * PGMs must have a maxval of 255, as pixels are compared to the
+     * threshold as they are.  The file must not be truncated while it is
+     * mapped: reading a row past the new end raises SIGBUS, which ends
+     * the run unless the image is processed in a child with --timelimit.
+     */
+    class MappedImage {
+    public:
+
+        MappedImage() : _map(NULL), _mapBytes(0), _pixels(NULL), _width(0),
+        _height(0), _stride(0), _bytesRead(0) {
+        }
+
+        virtual ~MappedImage() {
+            if (_map != NULL) {
+                munmap(_map, _mapBytes);
+            }
+        }
+
+        /**
+         * Maps path, a PGM if it has the PGM signature otherwise a raw image
+         * with a path + ".hdr" sidecar
+         */
+        void open(const std::string& path) {
+            _path = path;
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                fail(std::string("Unable to open for reading: ") +
+                        strerror(errno));
+            }
+            _mapBytes = st.st_size;
+            if (_mapBytes > 0) {
+                _map = mmap(NULL, _mapBytes, PROT_READ, MAP_SHARED, fd, 0);
+            }
+            ::close(fd);
+            if (_map == MAP_FAILED || _map == NULL) {
+                _map = NULL;
+                fail("Unable to map file");
+            }
+            madvise(_map, _mapBytes, MADV_RANDOM);
+
+            const unsigned char *data = (const unsigned char *) _map;
+            std::size_t offset;
+            if (isPgmSignature(data, _mapBytes)) {
+                offset = parsePgmHeader(data);
+                _stride = _width;
+            } else {
+                offset = parseSidecar(path + ".hdr");
+            }
+            if (_stride < (std::size_t) _width) {
+                fail("Row stride is less than the width");
+            }
+            if (_width > 0 && _height > 0 && (offset > _mapBytes ||
+                _mapBytes - offset < (std::size_t) _width ||
+                (_mapBytes - offset - _width) / _stride <
+                (std::size_t) _height - 1)) {
+                fail("Image is truncated");
+            }
+            _pixels = data + offset;
+        }
+
+        int getWidth() const {
+            return _width;
+        }
+
+        int getHeight() const {
+            return _height;
+        }
+
+        /**
+         * @return bytes between the starts of consecutive rows
+         */
+        std::size_t getStride() const {
+            return _stride;
+        }
+
+        /**
+         * @param y row to get, 0 <= y < getHeight()
+         * @return getWidth() pixels in the mapping
+         */
+        const unsigned char *getRow(int y) {
+            _bytesRead += _width;
+            return _pixels + (std::size_t) y * _stride;
+        }
+
+        /**
+         * @return bytes of the rows handed out by getRow(), the pages read
+         *         from disk are these rounded out to whole pages
+         */
+        uint64_t getBytesRead() const {
+            return _bytesRead;
+        }
+
+    private:
+        MappedImage(const MappedImage& orig);
+        MappedImage& operator=(const MappedImage& orig);
+
+        /**
+         * Parses "P5 <width> <height> <maxval>" plus # comments
+         * @return offset of the first pixel
+         */
+        std::size_t parsePgmHeader(const unsigned char *data) {
+            std::size_t pos = 2;
+            long fields[3];
+            for (int i = 0; i < 3; i++) {
+                while (pos < _mapBytes && (isspace(data[pos]) ||
+                        data[pos] == '#')) {
+                    if (data[pos] == '#') {
+                        while (pos < _mapBytes && data[pos] != '\n') {
+                            pos++;
+                        }
+                    } else {
+                        pos++;
+                    }
+                }
+                if (pos >= _mapBytes || !isdigit(data[pos])) {
+                    fail("Invalid PGM header");
+                }
+                fields[i] = 0;
+                while (pos < _mapBytes && isdigit(data[pos]) &&
+                        fields[i] <= 0x7fffffff) {
+                    fields[i] = fields[i] * 10 + (data[pos++] - '0');
+                }
+            }
+            // exactly one whitespace byte separates maxval from the pixels
+            if (pos >= _mapBytes || !isspace(data[pos]) ||
+                fields[0] > 0x7fffffff || fields[1] > 0x7fffffff) {
+                fail("Invalid PGM header");
+            }
+            // pixels are sampled in place, so they cannot be scaled to 0-255
+            if (fields[2] != 255) {
+                fail("Only PGM with a maxval of 255 is supported");
+            }
+            _width = fields[0];
+            _height = fields[1];
+            return pos + 1;
+        }
+
+        /**
+         * Reads width, height, offset and stride from a raw image sidecar
+         * @return offset of the first pixel
+         */
+        std::size_t parseSidecar(const std::string& sidecar) {
+            std::ifstream in(sidecar.c_str());
+            if (!in) {
+                fail("Unable to read sidecar header " + sidecar);
+            }
+            long long width = -1;
+            long long height = -1;
+            long long offset = 0;
+            long long stride = -1;
+            std::string line;
+            while (std::getline(in, line)) {
+                std::size_t hash = line.find('#');
+                if (hash != std::string::npos) {
+                    line.erase(hash);
+                }
+                std::istringstream fields(line);
+                std::string key;
+                long long value;
+                if (!(fields >> key)) {
+                    continue;
+                }
+                if (!(fields >> value) || value < 0) {
+                    fail("Invalid line in sidecar header " + sidecar + ": " +
+                            line);
+                }
+                if (key == "width") {
+                    width = value;
+                } else if (key == "height") {
+                    height = value;
+                } else if (key == "offset") {
+                    offset = value;
+                } else if (key == "stride") {
+                    stride = value;
+                } else {
+                    fail("Unknown key in sidecar header " + sidecar + ": " +
+                            key);
+                }
+            }
+            if (width < 0 || height < 0 || width > 0x7fffffff ||
+                height > 0x7fffffff) {
+                fail("Sidecar header " + sidecar + " needs width and height");
+            }
+            _width = width;
+            _height = height;
+            _stride = stride < 0 ? width : stride;
+            return offset;
+        }
+
+        void fail(const std::string& msg) {
+            throw itk::ExceptionObject(__FILE__, __LINE__, msg + ": " + _path,
+                    "spc::MappedImage");
+        }
+
+        std::string _path;
+        void *_map;
+        std::size_t _mapBytes;
+        const unsigned char *_pixels;
+        int _width;
+        int _height;
+        std::size_t _stride;
+        uint64_t _bytesRead;
+    };
+
+    /**
+     * Copies a PGM or raw .u8 image into an 8-bit greyscale image
+     * @param path image file
+     * @return image
+     */
+    template < typename TImageType >
+    typename TImageType::Pointer readMappedImage(const std::string& path) {
+        MappedImage mapped;
+        mapped.open(path);
+
+        typename TImageType::SizeType imageSize;
+        imageSize[0] = mapped.getWidth();
+        imageSize[1] = mapped.getHeight();
+        typename TImageType::IndexType start;
+        start[0] = 0;
+        start[1] = 0;
+        typename TImageType::RegionType region;
+        region.SetSize(imageSize);
+        region.SetIndex(start);
+
+        typename TImageType::Pointer image = TImageType::New();
+        image->SetRegions(region);
+        image->Allocate();
+        unsigned char *buffer = (unsigned char *) image->GetBufferPointer();
+        for (int y = 0; y < mapped.getHeight(); y++) {
+            memcpy(buffer + (std::size_t) y * mapped.getWidth(),
+                    mapped.getRow(y), mapped.getWidth());
+        }
+        return image;
+    }
+}
+
+#endif	/* MAPPEDIMAGE_HPP */
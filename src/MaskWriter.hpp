@@ -0,0 +1,159 @@
+/*
+ * File:   MaskWriter.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef MASKWRITER_HPP
+#define	MASKWRITER_HPP
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "ImageUtils.hpp"
+#include "PackedMask.hpp"
+#include "PngWriter.hpp"
+#include "StageTimer.hpp"
+
+namespace spc {
+
+    /**
+     * Output formats for thresholded masks
+     */
+    enum MaskFormat {
+        /**
+         * 1-bit greyscale PNG, pixels >= threshold are white
+         */
+        MASK_PNG,
+
+        /**
+         * Binary PBM (P4) packed bitmap, pixels >= threshold are set which
+         * PBM viewers display as black
+         */
+        MASK_PBM,
+
+        /**
+         * Packed mask (see PackedMaskHeader), packed bits with PackBits
+         * compressed rows and a row index, pixels >= threshold are set
+         */
+        MASK_SPM
+    };
+
+    /**
+     * Parses mask format name
+     * @param name png, pbm or spm
+     * @param format set to parsed format
+     * @return true if name is a known format
+     */
+    bool parseMaskFormat(const std::string& name, MaskFormat &format) {
+        if (name == "png") {
+            format = MASK_PNG;
+            return true;
+        }
+        if (name == "pbm") {
+            format = MASK_PBM;
+            return true;
+        }
+        if (name == "spm") {
+            format = MASK_SPM;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Writes the binarized (pixel >= threshold) version of image as a 1-bit
+     * mask.  Rows are thresholded, packed and written one at a time.
+     * @param source first row of 8-bit greyscale image
+     * @param stride bytes between the start of consecutive source rows
+     * @param width image width in pixels
+     * @param height image height in pixels
+     * @param threshold
+     * @param format output format
+     * @param path output file
+     * @param timer if not NULL thresholding and packing time is added to it
+     *        as rendering, compressing and writing time as encoding
+     */
+    void writeMaskImage(const unsigned char *source, std::size_t stride,
+            int width, int height, int threshold, MaskFormat format,
+            const std::string& path, RowStageTimer *timer = NULL) {
+        std::vector<unsigned char> packed((width + 7) / 8);
+
+        if (format == MASK_PNG) {
+            PngWriter writer;
+            writer.open(path, width, height, PngWriter::GREY_1BIT);
+            for (int y = 0; y < height; y++) {
+                thresholdAndPackRow(source + y * stride, width, threshold,
+                        &packed[0]);
+                if (timer != NULL) {
+                    timer->rendered();
+                }
+                writer.writeRow(&packed[0]);
+                if (timer != NULL) {
+                    timer->encoded();
+                }
+            }
+            writer.close();
+            if (timer != NULL) {
+                timer->encoded();
+            }
+            return;
+        }
+
+        if (format == MASK_SPM) {
+            PackedMaskWriter writer;
+            writer.open(path, width, height, threshold);
+            for (int y = 0; y < height; y++) {
+                thresholdAndPackRow(source + y * stride, width, threshold,
+                        &packed[0]);
+                if (timer != NULL) {
+                    timer->rendered();
+                }
+                writer.writeRow(&packed[0]);
+                if (timer != NULL) {
+                    timer->encoded();
+                }
+            }
+            writer.close();
+            if (timer != NULL) {
+                timer->encoded();
+            }
+            return;
+        }
+
+        FILE *fp = fopen(path.c_str(), "wb");
+        if (fp == NULL) {
+            throw itk::ExceptionObject(__FILE__, __LINE__,
+                    "Unable to open for writing: " + path, "spc::writeMaskImage");
+        }
+        char header[32];
+        int headerLen = snprintf(header, sizeof (header), "P4\n%d %d\n",
+                width, height);
+        bool ok = countedWrite(header, 1, headerLen, fp) ==
+                (std::size_t) headerLen;
+        for (int y = 0; ok && y < height; y++) {
+            thresholdAndPackRow(source + y * stride, width, threshold,
+                    &packed[0]);
+            if (timer != NULL) {
+                timer->rendered();
+            }
+            ok = countedWrite(&packed[0], 1, packed.size(), fp) ==
+                    packed.size();
+            if (timer != NULL) {
+                timer->encoded();
+            }
+        }
+        ok = (countedClose(fp) == 0) && ok;
+        if (timer != NULL) {
+            timer->encoded();
+        }
+        if (!ok) {
+            throw itk::ExceptionObject(__FILE__, __LINE__,
+                    "Error writing: " + path, "spc::writeMaskImage");
+        }
+    }
+}
+
+#endif	/* MASKWRITER_HPP */
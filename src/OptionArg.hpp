@@ -0,0 +1,67 @@
+/*
+ * File:   OptionArg.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef OPTIONARG_HPP
+#define	OPTIONARG_HPP
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <iostream>
+
+#include "optionparser.h"
+
+namespace spc {
+
+    /**
+     * Argument checks for the option::Descriptor tables of
+     * stereopointcounter and stereopointcounter_bench
+     */
+    struct Arg : public option::Arg {
+
+        /**
+         * Checks that arg in option is not NULL or 0
+         * @param option option parameter to examine
+         * @param msg if true then error messages will be output to standard error
+         * @return option::ARG_OK upon success or option::ARG_ILLEGAL upon failure
+         */
+        static option::ArgStatus Required(const option::Option& option, bool msg) {
+
+            if (option.arg != 0 || option.arg != NULL) {
+                return option::ARG_OK;
+            }
+
+            if (msg) std::cerr << "Option '" << option.name << "' requires an argument" << std::endl;
+            return option::ARG_ILLEGAL;
+        }
+
+        /**
+         * Checks that arg in option is not NULL or 0 and that its a directory
+         * @param option parameter to examine
+         * @param msg if true then error messages will be output to standard error
+         * @return option::ARG_OK if option.arg exists and is a directory otherwise option::ARG_ILLEGAL
+         */
+        static option::ArgStatus RequiredDir(const option::Option& option, bool msg) {
+            if (option.arg == 0 || option.arg == NULL) {
+                return option::ARG_ILLEGAL;
+            }
+
+            struct stat st;
+            if (stat(option.arg, &st) != 0) {
+                if (msg) std::cerr << "Error running stat on directory set under option '" << option.name << "'" << std::endl;
+                return option::ARG_ILLEGAL;
+            }
+            if (!S_ISDIR(st.st_mode)) {
+                if (msg) std::cerr << "Option '" << option.name << "' must be a directory" << std::endl;
+                return option::ARG_ILLEGAL;
+            }
+            return option::ARG_OK;
+        }
+
+    };
+}
+
+#endif	/* OPTIONARG_HPP */
@@ -0,0 +1,249 @@
+/*
+ * File:   OutputBuffer.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef OUTPUTBUFFER_HPP
+#define	OUTPUTBUFFER_HPP
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace spc {
+
+    /**
+     * Builds one line of output without iostreams.  The underlying string
+     * keeps its capacity across clear() so reusing a LineBuilder does not
+     * allocate once it has grown to the longest line.
+     */
+    class LineBuilder {
+    public:
+
+        LineBuilder() {
+            _line.reserve(256);
+        }
+
+        LineBuilder& append(const char *data, std::size_t len) {
+            _line.append(data, len);
+            return *this;
+        }
+
+        LineBuilder& append(const char *str) {
+            _line.append(str);
+            return *this;
+        }
+
+        LineBuilder& append(const std::string& str) {
+            _line.append(str);
+            return *this;
+        }
+
+        LineBuilder& append(char c) {
+            _line.push_back(c);
+            return *this;
+        }
+
+        LineBuilder& append(int value) {
+            return append((long long) value);
+        }
+
+        LineBuilder& append(long value) {
+            return append((long long) value);
+        }
+
+        LineBuilder& append(long long value) {
+            char digits[24];
+            char *end = digits + sizeof (digits);
+            char *p = end;
+            unsigned long long v = value < 0 ?
+                    0ULL - (unsigned long long) value : value;
+            do {
+                *--p = '0' + (v % 10);
+                v /= 10;
+            } while (v != 0);
+            if (value < 0) {
+                *--p = '-';
+            }
+            _line.append(p, end - p);
+            return *this;
+        }
+
+        /**
+         * Appends value formatted like std::ostream does by default (%g)
+         */
+        LineBuilder& append(double value) {
+            char buffer[32];
+            int len = snprintf(buffer, sizeof (buffer), "%g", value);
+            _line.append(buffer, len);
+            return *this;
+        }
+
+        /**
+         * Appends str as a quoted JSON string.  Quotes, backslashes and
+         * control characters are escaped, other bytes are copied as is.
+         */
+        LineBuilder& appendJsonString(const std::string& str) {
+            static const char hex[] = "0123456789abcdef";
+            _line.push_back('"');
+            for (std::size_t i = 0; i < str.size(); i++) {
+                unsigned char c = str[i];
+                if (c == '"' || c == '\\') {
+                    _line.push_back('\\');
+                    _line.push_back(c);
+                } else if (c < 0x20) {
+                    char escape[6] = {'\\', 'u', '0', '0', hex[c >> 4],
+                        hex[c & 15]};
+                    _line.append(escape, sizeof (escape));
+                } else {
+                    _line.push_back(c);
+                }
+            }
+            _line.push_back('"');
+            return *this;
+        }
+
+        void clear() {
+            _line.clear();
+        }
+
+        const std::string& str() const {
+            return _line;
+        }
+
+    private:
+        std::string _line;
+    };
+
+    /**
+     * Buffered writer for a file descriptor.  Output is collected in a
+     * large buffer and written when the buffer fills, when flush() is
+     * called, when flushInterval seconds have passed since the last write
+     * out, or on destruction.  Each write() is copied under a mutex so
+     * lines written by parallel workers never interleave.
+     */
+    class OutputBuffer {
+    public:
+
+        /**
+         * @param fd descriptor to write to, not closed by this object
+         * @param capacity buffer size in bytes
+         * @param flushInterval seconds after which buffered output is
+         *        written out by the next write(), 0 means only when the
+         *        buffer is full
+         */
+        OutputBuffer(int fd, std::size_t capacity = 1 << 20,
+                double flushInterval = 0.0) : _fd(fd), _buffer(capacity),
+        _used(0), _flushInterval(flushInterval), _failed(false),
+        _lastFlush(std::chrono::steady_clock::now()) {
+        }
+
+        virtual ~OutputBuffer() {
+            flush();
+        }
+
+        void setFlushInterval(double flushInterval) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _flushInterval = flushInterval;
+        }
+
+        /**
+         * Appends data, which should be whole lines
+         * @return false if a write to the descriptor has failed
+         */
+        bool write(const char *data, std::size_t len) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return appendLocked(data, len, false);
+        }
+
+        bool write(const std::string& str) {
+            return write(str.data(), str.size());
+        }
+
+        /**
+         * Appends line followed by a newline
+         * @return false if a write to the descriptor has failed
+         */
+        bool writeLine(const LineBuilder& line) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return appendLocked(line.str().data(), line.str().size(), true);
+        }
+
+        /**
+         * Writes out everything buffered
+         * @return false if a write to the descriptor has failed
+         */
+        bool flush() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return flushLocked();
+        }
+
+    private:
+        OutputBuffer(const OutputBuffer& orig);
+        OutputBuffer& operator=(const OutputBuffer& orig);
+
+        bool appendLocked(const char *data, std::size_t len, bool newline) {
+            std::size_t total = len + (newline ? 1 : 0);
+            if (_used + total > _buffer.size() && !flushLocked()) {
+                return false;
+            }
+            if (total > _buffer.size()) {
+                return writeFully(data, len) &&
+                        (!newline || writeFully("\n", 1));
+            }
+            memcpy(&_buffer[_used], data, len);
+            _used += len;
+            if (newline) {
+                _buffer[_used++] = '\n';
+            }
+            if (_flushInterval > 0.0) {
+                std::chrono::duration<double> elapsed =
+                        std::chrono::steady_clock::now() - _lastFlush;
+                if (elapsed.count() >= _flushInterval) {
+                    return flushLocked();
+                }
+            }
+            return !_failed;
+        }
+
+        bool flushLocked() {
+            bool ok = writeFully(_used > 0 ? &_buffer[0] : NULL, _used);
+            _used = 0;
+            _lastFlush = std::chrono::steady_clock::now();
+            return ok;
+        }
+
+        bool writeFully(const char *data, std::size_t len) {
+            while (len > 0 && !_failed) {
+                ssize_t numWritten = ::write(_fd, data, len);
+                if (numWritten < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (numWritten <= 0) {
+                    _failed = true;
+                    break;
+                }
+                data += numWritten;
+                len -= numWritten;
+            }
+            return !_failed;
+        }
+
+        int _fd;
+        std::vector<char> _buffer;
+        std::size_t _used;
+        double _flushInterval;
+        bool _failed;
+        std::chrono::steady_clock::time_point _lastFlush;
+        std::mutex _mutex;
+    };
+}
+
+#endif	/* OUTPUTBUFFER_HPP */
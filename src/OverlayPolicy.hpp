@@ -0,0 +1,204 @@
+/*
+ * File:   OverlayPolicy.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef OVERLAYPOLICY_HPP
+#define	OVERLAYPOLICY_HPP
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <random>
+#include <set>
+#include <string>
+
+#include "ImageUtils.hpp"
+
+namespace spc {
+
+    /**
+     * Decides which images get an overlay written when --saveimages is set.
+     * Any number of rules can be added and an image is selected if any one
+     * of them matches.  With no rules every image is selected.
+     *
+     * Supported rules:
+     *
+     *   all            every image
+     *   every:N        every Nth image (1st, N+1th, ...)
+     *   random:F[:S]   each image with probability F (0 - 1), seeded with S
+     *   zscore:Z       images whose positive fraction is more than Z standard
+     *                  deviations from the mean of the images seen before it
+     *   list:FILE      images whose path or file name is listed in FILE,
+     *                  one per line
+     */
+    class OverlayPolicy {
+    public:
+
+        /**
+         * Minimum number of prior images before zscore rule will select
+         * anything.
+         */
+        static const int ZSCORE_MIN_SAMPLES = 10;
+
+        OverlayPolicy() : _all(false), _everyN(0), _randomFraction(-1.0),
+        _zscore(-1.0), _useList(false), _imageCount(0), _mean(0.0), _m2(0.0) {
+        }
+
+        /**
+         * Adds rule to policy
+         * @param spec rule in format described in class documentation
+         * @param error set to reason upon failure
+         * @return true if rule was added, false if spec is invalid
+         */
+        bool addRule(const std::string& spec, std::string& error) {
+            std::string name = spec;
+            std::string value;
+            std::size_t colon = spec.find(':');
+            if (colon != std::string::npos) {
+                name = spec.substr(0, colon);
+                value = spec.substr(colon + 1);
+            }
+            char *end = NULL;
+            if (name == "all") {
+                _all = true;
+                return true;
+            }
+            if (name == "every") {
+                long n = strtol(value.c_str(), &end, 10);
+                if (value.empty() || *end != '\0' || n < 1) {
+                    error = "every:N requires N >= 1";
+                    return false;
+                }
+                _everyN = n;
+                return true;
+            }
+            if (name == "random") {
+                std::string seed;
+                std::size_t seedColon = value.find(':');
+                if (seedColon != std::string::npos) {
+                    seed = value.substr(seedColon + 1);
+                    value = value.substr(0, seedColon);
+                }
+                double f = strtod(value.c_str(), &end);
+                if (value.empty() || *end != '\0' || f < 0.0 || f > 1.0) {
+                    error = "random:F requires 0 <= F <= 1";
+                    return false;
+                }
+                unsigned long s = 0;
+                if (!seed.empty()) {
+                    s = strtoul(seed.c_str(), &end, 10);
+                    if (*end != '\0') {
+                        error = "random:F:S requires integer seed S";
+                        return false;
+                    }
+                }
+                _randomFraction = f;
+                _rng.seed(s);
+                return true;
+            }
+            if (name == "zscore") {
+                double z = strtod(value.c_str(), &end);
+                if (value.empty() || *end != '\0' || z < 0.0) {
+                    error = "zscore:Z requires Z >= 0";
+                    return false;
+                }
+                _zscore = z;
+                return true;
+            }
+            if (name == "list") {
+                std::ifstream in(value.c_str());
+                if (!in) {
+                    error = "unable to open list file " + value;
+                    return false;
+                }
+                std::string line;
+                _useList = true;
+                while (std::getline(in, line)) {
+                    if (!line.empty() && line[line.length() - 1] == '\r') {
+                        line.erase(line.length() - 1);
+                    }
+                    if (!line.empty()) {
+                        _list.insert(line);
+                    }
+                }
+                return true;
+            }
+            error = "unknown policy " + name;
+            return false;
+        }
+
+        /**
+         * Decides if overlay should be written for image and then adds
+         * image to the running statistics.  Must be called once per image
+         * in processing order.
+         * @param path path of image as reported in output
+         * @param positive number of positive intersections
+         * @param total number of intersections
+         * @return true if overlay should be rendered
+         */
+        bool select(const std::string& path, int positive, int total) {
+            double fraction = 0.0;
+            if (total > 0) {
+                fraction = (double) positive / (double) total;
+            }
+            bool selected = isSelected(path, fraction);
+
+            // Welford running mean/variance of positive fraction
+            _imageCount++;
+            double delta = fraction - _mean;
+            _mean += delta / _imageCount;
+            _m2 += delta * (fraction - _mean);
+            return selected;
+        }
+
+    private:
+
+        bool isSelected(const std::string& path, double fraction) {
+            bool hasRule = false;
+            bool selected = _all;
+            hasRule = hasRule || _all;
+            if (_everyN > 0) {
+                hasRule = true;
+                selected = selected || (_imageCount % _everyN) == 0;
+            }
+            if (_randomFraction >= 0.0) {
+                hasRule = true;
+                // always draw so sequence does not depend on other rules
+                bool hit = _uniform(_rng) < _randomFraction;
+                selected = selected || hit;
+            }
+            if (_zscore >= 0.0) {
+                hasRule = true;
+                if (_imageCount >= ZSCORE_MIN_SAMPLES) {
+                    double stddev = sqrt(_m2 / (_imageCount - 1));
+                    double deviation = fabs(fraction - _mean);
+                    selected = selected || deviation > _zscore * stddev;
+                }
+            }
+            if (_useList) {
+                hasRule = true;
+                selected = selected || _list.count(path) > 0 ||
+                        _list.count(getFileNameFromPath(path)) > 0;
+            }
+            return selected || !hasRule;
+        }
+
+        bool _all;
+        long _everyN;
+        double _randomFraction;
+        double _zscore;
+        bool _useList;
+        std::set<std::string> _list;
+        std::mt19937 _rng;
+        std::uniform_real_distribution<double> _uniform;
+
+        long _imageCount;
+        double _mean;
+        double _m2;
+    };
+}
+
+#endif	/* OVERLAYPOLICY_HPP */
@@ -0,0 +1,212 @@
+/*
+ * File:   OverlayRenderer.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef OVERLAYRENDERER_HPP
+#define	OVERLAYRENDERER_HPP
+
+#include <math.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ImageUtils.hpp"
+#include "PngWriter.hpp"
+#include "StageTimer.hpp"
+
+namespace spc {
+
+    /**
+     * Generates overlay rows one at a time from the matching source row,
+     * the grid and the circle stencil around each positive intersection.
+     * Output is identical to drawGridOnImage() and
+     * drawCirclesAroundPointsOnImage() on the image mapped to overlay
+     * palette indices with greyToPaletteIndex(), except circles running off
+     * the image edge are clipped, but no image sized buffer is ever
+     * created.
+     */
+    class OverlayRowRenderer {
+    public:
+
+        /**
+         * @param width image width in pixels
+         * @param height image height in pixels
+         * @param gridWidth spacing in pixels between vertical gridlines
+         * @param gridHeight spacing in pixels between horizontal gridlines
+         * @param locations positive intersections, first is X second is Y
+         * @param circleRadius radius of circle drawn around each location
+         */
+        OverlayRowRenderer(int width, int height, int gridWidth, int gridHeight,
+                const std::vector< std::pair<int, int> > &locations,
+                double circleRadius) :
+        _width(width), _height(height), _gridWidth(gridWidth),
+        _gridHeight(gridHeight) {
+            for (int i = 0; i < 256; i++) {
+                _lut[i] = greyToPaletteIndex(i);
+            }
+            std::vector< std::pair<int, int> >::const_iterator itr;
+            for (itr = locations.begin(); itr != locations.end(); itr++) {
+                _markerRows[itr->second].push_back(itr->first);
+            }
+
+            // same points drawCircle() visits, grouped by row offset
+            std::set< std::pair<int, int> > points;
+            points.insert(std::make_pair(0, 0));
+            double pi_double = 2 * spc::PI;
+            for (double angle = 0; angle < pi_double; angle += 0.1) {
+                points.insert(std::make_pair(
+                        (int) floor(circleRadius * sin(angle)),
+                        (int) floor(circleRadius * cos(angle))));
+            }
+            std::set< std::pair<int, int> >::iterator pitr;
+            for (pitr = points.begin(); pitr != points.end(); pitr++) {
+                _stencil[pitr->first].push_back(pitr->second);
+            }
+        }
+
+        int getWidth() const {
+            return _width;
+        }
+
+        int getHeight() const {
+            return _height;
+        }
+
+        /**
+         * Renders row y of the overlay as palette indices
+         * (see createOverlayPalette())
+         * @param y row to render
+         * @param source row y of the 8-bit greyscale source image
+         * @param dest buffer of width bytes to write indices to
+         */
+        void renderRow(int y, const unsigned char *source,
+                unsigned char *dest) const {
+            for (int x = 0; x < _width; x++) {
+                dest[x] = _lut[source[x]];
+            }
+            drawGridRow(y, dest);
+            drawMarkersRow(y, dest);
+        }
+
+        /**
+         * Renders row y of the overlay as r,g,b triplets
+         * @param y row to render
+         * @param source row y of the 8-bit greyscale source image
+         * @param palette palette from createOverlayPalette()
+         * @param indexRow scratch buffer of width bytes
+         * @param dest buffer of 3 * width bytes to write to
+         */
+        void renderRGBRow(int y, const unsigned char *source,
+                std::vector<RGBPixelType> const &palette,
+                unsigned char *indexRow, unsigned char *dest) const {
+            renderRow(y, source, indexRow);
+            for (int x = 0; x < _width; x++) {
+                const RGBPixelType &p = palette[indexRow[x]];
+                dest[3 * x] = p.GetRed();
+                dest[3 * x + 1] = p.GetGreen();
+                dest[3 * x + 2] = p.GetBlue();
+            }
+        }
+
+    private:
+
+        bool onGridLine(int v, int spacing) const {
+            return v % spacing == 0 || (v - 1) % spacing == 0 ||
+                    (v + 1) % spacing == 0;
+        }
+
+        void drawGridRow(int y, unsigned char *dest) const {
+            if (_gridWidth <= 0 || _gridHeight <= 0) {
+                return;
+            }
+            if (y >= _gridHeight && y % _gridHeight == 0) {
+                for (int x = 0; x < _width; x++) {
+                    if (!onGridLine(x, _gridWidth)) {
+                        dest[x] = PALETTE_GRID_INDEX;
+                    }
+                }
+            }
+            if (!onGridLine(y, _gridHeight)) {
+                for (int x = _gridWidth; x < _width; x += _gridWidth) {
+                    dest[x] = PALETTE_GRID_INDEX;
+                }
+            }
+        }
+
+        void drawMarkersRow(int y, unsigned char *dest) const {
+            std::map<int, std::vector<int> >::const_iterator sitr;
+            for (sitr = _stencil.begin(); sitr != _stencil.end(); sitr++) {
+                std::map<int, std::vector<int> >::const_iterator mitr =
+                        _markerRows.find(y - sitr->first);
+                if (mitr == _markerRows.end()) {
+                    continue;
+                }
+                const std::vector<int> &xs = mitr->second;
+                const std::vector<int> &dxs = sitr->second;
+                for (std::size_t i = 0; i < xs.size(); i++) {
+                    for (std::size_t j = 0; j < dxs.size(); j++) {
+                        int x = xs[i] + dxs[j];
+                        if (x >= 0 && x < _width) {
+                            dest[x] = PALETTE_MARKER_INDEX;
+                        }
+                    }
+                }
+            }
+        }
+
+        int _width;
+        int _height;
+        int _gridWidth;
+        int _gridHeight;
+        unsigned char _lut[256];
+
+        // row -> x coordinates of positive intersections on that row
+        std::map<int, std::vector<int> > _markerRows;
+
+        // row offset -> column offsets of circle pixels
+        std::map<int, std::vector<int> > _stencil;
+    };
+
+    /**
+     * Renders overlay and encodes it as an 8-bit palette PNG one row at a
+     * time.  Memory used is proportional to image width only.
+     * @param renderer renderer set up for the image
+     * @param source first row of the 8-bit greyscale source image
+     * @param stride bytes between the start of consecutive source rows
+     * @param palette palette from createOverlayPalette()
+     * @param path output file
+     * @param timer if not NULL rendering and encoding time is added to it
+     */
+    void writeOverlayImage(OverlayRowRenderer const &renderer,
+            const unsigned char *source, std::size_t stride,
+            std::vector<RGBPixelType> const &palette,
+            std::string const &path, RowStageTimer *timer = NULL) {
+        int width = renderer.getWidth();
+        int height = renderer.getHeight();
+        std::vector<unsigned char> row(width);
+
+        PngWriter writer;
+        writer.open(path, width, height, PngWriter::PALETTE, &palette);
+        for (int y = 0; y < height; y++) {
+            renderer.renderRow(y, source + y * stride, &row[0]);
+            if (timer != NULL) {
+                timer->rendered();
+            }
+            writer.writeRow(&row[0]);
+            if (timer != NULL) {
+                timer->encoded();
+            }
+        }
+        writer.close();
+        if (timer != NULL) {
+            timer->encoded();
+        }
+    }
+}
+
+#endif	/* OVERLAYRENDERER_HPP */
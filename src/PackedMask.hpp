@@ -0,0 +1,512 @@
+/*
+ * File:   PackedMask.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef PACKEDMASK_HPP
+#define	PACKEDMASK_HPP
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <exception>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "itkImage.h"
+
+#include "ImageUtils.hpp"
+#include "OutputBuffer.hpp"
+#include "StageTimer.hpp"
+#include "StreamingSampler.hpp"
+
+namespace spc {
+
+    /**
+     * Header at offset 0 of a packed mask (.spm) file.  It is followed by
+     * height + 1 uint64 file offsets, row y being the bytes from offset y
+     * to offset y + 1, and then the rows.  A row is (width + 7) / 8 bytes of
+     * bits packed most significant bit first, or PackBits compressed if
+     * that is shorter.  Values are in native (little endian) byte order.
+     */
+    struct PackedMaskHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrderMark;
+        int32_t width;
+        int32_t height;
+        int32_t threshold;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof (PackedMaskHeader) == 32, "header must be packed");
+
+    const char PACKED_MASK_MAGIC[8] = {'S', 'P', 'C', 'M', 'A', 'S', 'K',
+        '\0'};
+    const uint32_t PACKED_MASK_BYTE_ORDER_MARK = 0x01020304;
+
+    /**
+     * Compresses data with PackBits: runs of 3 to 128 equal bytes become a
+     * count and the byte, everything else is copied in literal blocks of up
+     * to 128 bytes
+     * @param out set to compressed data
+     */
+    inline void packBitsEncode(const unsigned char *data, std::size_t n,
+            std::vector<unsigned char> &out) {
+        out.clear();
+        std::size_t i = 0;
+        while (i < n) {
+            std::size_t run = 1;
+            while (i + run < n && run < 128 && data[i + run] == data[i]) {
+                run++;
+            }
+            if (run >= 3) {
+                out.push_back((unsigned char) (257 - run));
+                out.push_back(data[i]);
+                i += run;
+                continue;
+            }
+            std::size_t start = i;
+            while (i < n && i - start < 128) {
+                if (i + 2 < n && data[i] == data[i + 1] &&
+                    data[i] == data[i + 2]) {
+                    break;
+                }
+                i++;
+            }
+            out.push_back((unsigned char) (i - start - 1));
+            out.insert(out.end(), data + start, data + i);
+        }
+    }
+
+    /**
+     * @param dest buffer of n bytes
+     * @return false unless data decodes to exactly n bytes
+     */
+    inline bool packBitsDecode(const unsigned char *data, std::size_t len,
+            unsigned char *dest, std::size_t n) {
+        std::size_t i = 0;
+        std::size_t o = 0;
+        while (i < len) {
+            int count = (signed char) data[i++];
+            if (count >= 0) {
+                std::size_t literal = count + 1;
+                if (i + literal > len || o + literal > n) {
+                    return false;
+                }
+                memcpy(dest + o, data + i, literal);
+                i += literal;
+                o += literal;
+            } else if (count != -128) {
+                std::size_t run = 1 - count;
+                if (i >= len || o + run > n) {
+                    return false;
+                }
+                memset(dest + o, data[i++], run);
+                o += run;
+            }
+        }
+        return o == n;
+    }
+
+    /**
+     * Writes a packed mask (.spm) file one row at a time
+     */
+    class PackedMaskWriter {
+    public:
+
+        PackedMaskWriter() : _fp(NULL), _rowBytes(0), _offset(0) {
+        }
+
+        virtual ~PackedMaskWriter() {
+            if (_fp != NULL) {
+                fclose(_fp);
+            }
+        }
+
+        /**
+         * @param path output file
+         * @param width mask width in pixels
+         * @param height mask height in pixels
+         * @param threshold recorded in header
+         */
+        void open(const std::string& path, int width, int height,
+                int threshold) {
+            _path = path;
+            _fp = fopen(path.c_str(), "wb");
+            if (_fp == NULL) {
+                fail("Unable to open for writing");
+            }
+            PackedMaskHeader header;
+            memset(&header, 0, sizeof (header));
+            memcpy(header.magic, PACKED_MASK_MAGIC, sizeof (header.magic));
+            header.version = 1;
+            header.byteOrderMark = PACKED_MASK_BYTE_ORDER_MARK;
+            header.width = width;
+            header.height = height;
+            header.threshold = threshold;
+            _rowBytes = (width + 7) / 8;
+            _offsets.clear();
+            _offsets.reserve(height + 1);
+            // row offsets are filled in by close()
+            std::vector<uint64_t> table(height + 1, 0);
+            if (countedWrite(&header, sizeof (header), 1, _fp) != 1 ||
+                countedWrite(&table[0], sizeof (uint64_t), table.size(),
+                _fp) != table.size()) {
+                fail("Error writing");
+            }
+            _offset = sizeof (header) + table.size() * sizeof (uint64_t);
+        }
+
+        /**
+         * @param row (width + 7) / 8 bytes of packed bits
+         */
+        void writeRow(const unsigned char *row) {
+            packBitsEncode(row, _rowBytes, _encoded);
+            const unsigned char *data = row;
+            std::size_t len = _rowBytes;
+            if (_encoded.size() < _rowBytes) {
+                data = &_encoded[0];
+                len = _encoded.size();
+            }
+            if (len > 0 && countedWrite(data, 1, len, _fp) != len) {
+                fail("Error writing");
+            }
+            _offsets.push_back(_offset);
+            _offset += len;
+        }
+
+        /**
+         * Writes row offsets and closes file.  All rows must have been
+         * written.
+         */
+        void close() {
+            _offsets.push_back(_offset);
+            bool ok = fseeko(_fp, sizeof (PackedMaskHeader), SEEK_SET) == 0 &&
+                    countedWrite(&_offsets[0], sizeof (uint64_t),
+                    _offsets.size(), _fp) == _offsets.size();
+            ok = countedClose(_fp) == 0 && ok;
+            _fp = NULL;
+            if (!ok) {
+                fail("Error writing");
+            }
+        }
+
+    private:
+        PackedMaskWriter(const PackedMaskWriter& orig);
+        PackedMaskWriter& operator=(const PackedMaskWriter& orig);
+
+        void fail(const std::string& msg) {
+            if (_fp != NULL) {
+                fclose(_fp);
+                _fp = NULL;
+            }
+            throw itk::ExceptionObject(__FILE__, __LINE__, msg + ": " + _path,
+                    "spc::PackedMaskWriter");
+        }
+
+        FILE *_fp;
+        std::string _path;
+        std::size_t _rowBytes;
+        uint64_t _offset;
+        std::vector<uint64_t> _offsets;
+        std::vector<unsigned char> _encoded;
+    };
+
+    /**
+     * Memory maps a packed mask (.spm) or binary PBM (P4) file and hands
+     * out its rows as packed bits, most significant bit first.  Rows of a
+     * .spm file can be read in any order without decoding the rows before
+     * them.
+     */
+    class PackedMask {
+    public:
+
+        PackedMask() : _map(NULL), _mapBytes(0), _width(0), _height(0),
+        _threshold(-1), _rowBytes(0), _offsets(NULL), _pbmData(NULL) {
+        }
+
+        virtual ~PackedMask() {
+            if (_map != NULL) {
+                munmap(_map, _mapBytes);
+            }
+        }
+
+        /**
+         * Maps path and reads its header
+         */
+        void open(const std::string& path) {
+            _path = path;
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                fail(std::string("Unable to open for reading: ") +
+                        strerror(errno));
+            }
+            _mapBytes = st.st_size;
+            if (_mapBytes > 0) {
+                _map = mmap(NULL, _mapBytes, PROT_READ, MAP_SHARED, fd, 0);
+            }
+            ::close(fd);
+            if (_map == MAP_FAILED || _map == NULL) {
+                _map = NULL;
+                fail("Unable to map file");
+            }
+            const char *data = (const char *) _map;
+            if (_mapBytes >= sizeof (PackedMaskHeader) &&
+                memcmp(data, PACKED_MASK_MAGIC, 8) == 0) {
+                openPackedMask();
+            } else if (_mapBytes >= 2 && data[0] == 'P' && data[1] == '4') {
+                openPbm();
+            } else {
+                fail("Not a packed mask or PBM file");
+            }
+        }
+
+        int getWidth() const {
+            return _width;
+        }
+
+        int getHeight() const {
+            return _height;
+        }
+
+        /**
+         * @return threshold the mask was made with, -1 if unknown (PBM)
+         */
+        int getThreshold() const {
+            return _threshold;
+        }
+
+        std::size_t getRowBytes() const {
+            return _rowBytes;
+        }
+
+        /**
+         * @param y row to get
+         * @param buffer used if row has to be decompressed
+         * @return getRowBytes() bytes of packed bits, valid until buffer
+         *         changes or the mask is destroyed
+         */
+        const unsigned char *getRow(int y,
+                std::vector<unsigned char> &buffer) {
+            if (_pbmData != NULL) {
+                return _pbmData + (std::size_t) y * _rowBytes;
+            }
+            const unsigned char *row = (const unsigned char *) _map +
+                    _offsets[y];
+            std::size_t len = _offsets[y + 1] - _offsets[y];
+            if (len == _rowBytes) {
+                return row;
+            }
+            buffer.resize(_rowBytes);
+            if (!packBitsDecode(row, len, &buffer[0], _rowBytes)) {
+                fail("Corrupt row");
+            }
+            return &buffer[0];
+        }
+
+    private:
+        PackedMask(const PackedMask& orig);
+        PackedMask& operator=(const PackedMask& orig);
+
+        void openPackedMask() {
+            const PackedMaskHeader *header = (const PackedMaskHeader *) _map;
+            if (header->version != 1 ||
+                header->byteOrderMark != PACKED_MASK_BYTE_ORDER_MARK ||
+                header->width < 0 || header->height < 0 ||
+                (uint64_t) header->height + 1 > (_mapBytes -
+                sizeof (*header)) / sizeof (uint64_t)) {
+                fail("Not a packed mask file, truncated or wrong byte order");
+            }
+            _width = header->width;
+            _height = header->height;
+            _threshold = header->threshold;
+            _rowBytes = (_width + 7) / 8;
+            _offsets = (const uint64_t *) ((const char *) _map +
+                    sizeof (*header));
+            uint64_t start = sizeof (*header) + ((uint64_t) _height + 1) *
+                    sizeof (uint64_t);
+            for (int y = 0; y <= _height; y++) {
+                if (_offsets[y] < start || _offsets[y] > _mapBytes ||
+                    (y < _height && (_offsets[y + 1] < _offsets[y] ||
+                    _offsets[y + 1] - _offsets[y] > _rowBytes))) {
+                    fail("Packed mask file is truncated or corrupt");
+                }
+            }
+        }
+
+        void openPbm() {
+            const char *data = (const char *) _map;
+            std::size_t pos = 2;
+            long values[2];
+            for (int i = 0; i < 2; i++) {
+                // whitespace and # comments may separate header fields
+                while (pos < _mapBytes && (isspace(data[pos]) ||
+                        data[pos] == '#')) {
+                    if (data[pos] == '#') {
+                        while (pos < _mapBytes && data[pos] != '\n') {
+                            pos++;
+                        }
+                    } else {
+                        pos++;
+                    }
+                }
+                values[i] = 0;
+                std::size_t digits = pos;
+                while (pos < _mapBytes && isdigit(data[pos]) &&
+                        values[i] < (1L << 30)) {
+                    values[i] = values[i] * 10 + (data[pos++] - '0');
+                }
+                if (pos == digits) {
+                    fail("Malformed PBM header");
+                }
+            }
+            // exactly one whitespace byte precedes the bits
+            pos++;
+            _width = values[0];
+            _height = values[1];
+            _rowBytes = (_width + 7) / 8;
+            if (pos > _mapBytes ||
+                (uint64_t) _rowBytes * _height > _mapBytes - pos) {
+                fail("PBM file is truncated");
+            }
+            _pbmData = (const unsigned char *) _map + pos;
+        }
+
+        void fail(const std::string& msg) {
+            throw itk::ExceptionObject(__FILE__, __LINE__, msg + ": " + _path,
+                    "spc::PackedMask");
+        }
+
+        std::string _path;
+        void *_map;
+        std::size_t _mapBytes;
+        int _width;
+        int _height;
+        int _threshold;
+        std::size_t _rowBytes;
+        const uint64_t *_offsets;
+        const unsigned char *_pbmData;
+    };
+
+    /**
+     * Samples the grid intersections of a packed mask, the same ones
+     * getIntersectionPixelsAboveThreshold uses.  Each grid row is ANDed
+     * with a packed mask of the grid columns and counted with popcount,
+     * only grid rows are decoded unless the area fraction is wanted.
+     * @param positive set to intersections whose bit is set
+     * @param total set to number of intersections
+     * @param setPixels if not NULL set to number of bits set in the whole
+     *        mask, which requires reading every row
+     */
+    inline void sampleMaskGrid(PackedMask &mask, int gridx, int gridy,
+            int &positive, int &total, int &gridWidth, int &gridHeight,
+            std::size_t *setPixels = NULL) {
+        int width = mask.getWidth();
+        int height = mask.getHeight();
+        std::size_t rowBytes = mask.getRowBytes();
+        getGridSpacing(width, height, gridx, gridy, gridWidth, gridHeight);
+        positive = 0;
+        total = gridLineCount(width, gridWidth) *
+                gridLineCount(height, gridHeight);
+        std::vector<unsigned char> columns(rowBytes, 0);
+        for (int x = gridWidth; gridWidth > 0 && x < width; x += gridWidth) {
+            columns[x / 8] |= 0x80 >> (x % 8);
+        }
+        std::vector<unsigned char> buffer;
+        if (setPixels == NULL) {
+            for (int y = gridHeight; total > 0 && y < height;
+                    y += gridHeight) {
+                positive += popcountAnd(mask.getRow(y, buffer), &columns[0],
+                        rowBytes);
+            }
+            return;
+        }
+        *setPixels = 0;
+        // bits past width in the last byte are not pixels
+        unsigned char lastMask = width % 8 == 0 ? 0xff :
+                (unsigned char) (0xff << (8 - width % 8));
+        for (int y = 0; y < height && rowBytes > 0; y++) {
+            const unsigned char *row = mask.getRow(y, buffer);
+            *setPixels += popcountBytes(row, rowBytes - 1) +
+                    __builtin_popcount(row[rowBytes - 1] & lastMask);
+            if (total > 0 && y % gridHeight == 0 && y > 0) {
+                positive += popcountAnd(row, &columns[0], rowBytes);
+            }
+        }
+    }
+
+    /**
+     * Writes grid counts and area fraction (fraction of pixels set) of
+     * every mask as CSV followed by a summary, the same output a run over
+     * the images with the masks' threshold would have written plus an
+     * AreaFraction column.  Masks that cannot be read are reported on
+     * errors as Error,<mask>,<reason> and counted in FailedImages.
+     * @param masks .spm or PBM files
+     * @param out where output is written
+     * @param errors where failures are reported
+     * @return number of masks that failed
+     */
+    inline int sampleMaskGrids(const std::vector<std::string>& masks,
+            int gridx, int gridy, OutputBuffer& out, std::ostream& errors) {
+        std::chrono::steady_clock::time_point startTime =
+                std::chrono::steady_clock::now();
+        long long totalPositive = 0;
+        long long total = 0;
+        int failed = 0;
+        LineBuilder line;
+        out.write("Image,GridSize,GridSizePixel,Positive,Total,"
+                "AreaFraction\n");
+        for (std::size_t i = 0; i < masks.size(); i++) {
+            int positive, imageTotal, gridWidth, gridHeight;
+            std::size_t setPixels;
+            double pixels;
+            try {
+                PackedMask mask;
+                mask.open(masks[i]);
+                sampleMaskGrid(mask, gridx, gridy, positive, imageTotal,
+                        gridWidth, gridHeight, &setPixels);
+                pixels = (double) mask.getWidth() * mask.getHeight();
+            } catch (std::exception& e) {
+                failed++;
+                errors << "Error," << masks[i] << ","
+                        << singleLine(e.what()) << std::endl;
+                continue;
+            }
+            line.clear();
+            line.append(masks[i]).append(',').append(gridx).append('x')
+                    .append(gridy).append(',').append(gridWidth).append('x')
+                    .append(gridHeight).append(',').append(positive)
+                    .append(',').append(imageTotal).append(',')
+                    .append(pixels > 0 ? setPixels / pixels : 0.0);
+            out.writeLine(line);
+            totalPositive += positive;
+            total += imageTotal;
+        }
+        std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - startTime;
+        out.write("\nSeconds,GrandTotalPositive,GrandTotal,FailedImages\n");
+        line.clear();
+        line.append(elapsed.count()).append(',').append(totalPositive)
+                .append(',').append(total).append(',').append(failed);
+        out.writeLine(line);
+        return failed;
+    }
+}
+
+#endif	/* PACKEDMASK_HPP */
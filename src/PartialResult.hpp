@@ -0,0 +1,292 @@
+/*
+ * File:   PartialResult.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef PARTIALRESULT_HPP
+#define	PARTIALRESULT_HPP
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <functional>
+#include <ostream>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace spc {
+
+    /**
+     * Parses a --shard value of the form i/N
+     * @param spec value to parse
+     * @param shardIndex set to i, 0 <= i < N
+     * @param shardCount set to N
+     * @return false if spec is malformed
+     */
+    bool parseShard(const std::string& spec, int &shardIndex,
+            int &shardCount) {
+        char *end;
+        shardIndex = strtol(spec.c_str(), &end, 10);
+        if (end == spec.c_str() || *end != '/') {
+            return false;
+        }
+        const char *countStr = end + 1;
+        shardCount = strtol(countStr, &end, 10);
+        return end != countStr && *end == '\0' && shardCount > 0 &&
+                shardIndex >= 0 && shardIndex < shardCount;
+    }
+
+    /**
+     * Writes the partial result of one shard of a run: every image's row
+     * tagged with its position in the full input list, plus the shard's
+     * totals.  mergePartialResults() turns the partial results of all
+     * shards into the output of a single run.
+     *
+     * Format is text, one record per line:
+     *
+     *   stereopointcounter-partial 1
+     *   shard <i> <N>
+     *   params <gridx> <gridy> <threshold>
+     *   row <index> <positive> <total> <csv row>
+     *   ...
+     *   summary <seconds> <failed images>
+     *
+     * Rows are in increasing index order.
+     */
+    class PartialResultWriter {
+    public:
+
+        PartialResultWriter() : _fp(NULL) {
+        }
+
+        virtual ~PartialResultWriter() {
+            if (_fp != NULL) {
+                fclose(_fp);
+            }
+        }
+
+        /**
+         * Creates partial result file, replacing any existing one
+         * @param error set to reason upon failure
+         * @return false upon failure
+         */
+        bool open(const std::string& path, int shardIndex, int shardCount,
+                int gridX, int gridY, int threshold, std::string& error) {
+            _fp = fopen(path.c_str(), "w");
+            if (_fp == NULL) {
+                error = strerror(errno);
+                return false;
+            }
+            if (fprintf(_fp, "stereopointcounter-partial 1\nshard %d %d\n"
+                    "params %d %d %d\n", shardIndex, shardCount, gridX, gridY,
+                    threshold) < 0) {
+                error = strerror(errno);
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * @param index position of image in full input list
+         * @param csv the image's output row without newline
+         */
+        bool addRow(long index, int positive, int total,
+                const std::string& csv) {
+            return fprintf(_fp, "row %ld %d %d %s\n", index, positive, total,
+                    csv.c_str()) >= 0;
+        }
+
+        /**
+         * Writes totals and closes file
+         * @param seconds time taken by the shard
+         * @param failed number of images that failed
+         */
+        bool close(double seconds, int failed) {
+            bool ok = fprintf(_fp, "summary %.17g %d\n", seconds, failed) >= 0;
+            ok = fclose(_fp) == 0 && ok;
+            _fp = NULL;
+            return ok;
+        }
+
+    private:
+        PartialResultWriter(const PartialResultWriter& orig);
+        PartialResultWriter& operator=(const PartialResultWriter& orig);
+
+        FILE *_fp;
+    };
+
+    /**
+     * Reads the last line of a file
+     * @return false if file could not be read
+     */
+    bool readLastLine(const std::string& path, std::string& line) {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        in.seekg(0, std::ios::end);
+        std::streamoff size = in.tellg();
+        std::streamoff start = size > 4096 ? size - 4096 : 0;
+        in.seekg(start);
+        std::string tail((std::size_t) (size - start), '\0');
+        in.read(&tail[0], tail.size());
+        while (!tail.empty() && tail[tail.size() - 1] == '\n') {
+            tail.erase(tail.size() - 1);
+        }
+        std::size_t newline = tail.find_last_of('\n');
+        line = newline == std::string::npos ? tail : tail.substr(newline + 1);
+        return true;
+    }
+
+    /**
+     * Reads next row record of a partial result
+     * @param csvStart set to offset of csv row within line
+     * @return false at summary or end of file
+     */
+    bool readRow(std::istream& in, std::string& line, long &index,
+            int &positive, int &total, std::size_t &csvStart) {
+        while (std::getline(in, line)) {
+            int consumed = 0;
+            if (sscanf(line.c_str(), "row %ld %d %d%n", &index, &positive,
+                    &total, &consumed) == 3 && consumed > 0 &&
+                line.size() > (std::size_t) consumed) {
+                csvStart = consumed + 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Merges partial results written by PartialResultWriter for every shard
+     * of a run into the CSV and summary a single run would have written.
+     * Rows are merged by index a line at a time so memory use does not
+     * depend on the number of images.  Seconds is the sum over the shards.
+     * @param paths partial result files, one per shard, in any order
+     * @param out where merged output is written
+     * @param error set to reason upon failure
+     * @return false if files are unreadable, were written with different
+     *         parameters, or do not cover every shard exactly once
+     */
+    bool mergePartialResults(const std::vector<std::string>& paths,
+            std::ostream& out, std::string& error) {
+        std::vector<std::ifstream *> inputs;
+        std::vector<int> params;
+        int shardCount = 0;
+        std::set<int> shards;
+        double seconds = 0.0;
+        long long failed = 0;
+        bool ok = true;
+        for (std::size_t i = 0; i < paths.size() && ok; i++) {
+            std::ifstream *in = new std::ifstream(paths[i].c_str());
+            inputs.push_back(in);
+            std::string magic, shardKey, paramsKey;
+            int version = 0, index = -1, count = 0;
+            std::vector<int> p(3, 0);
+            if (!(*in >> magic >> version >> shardKey >> index >> count >>
+                paramsKey >> p[0] >> p[1] >> p[2]) ||
+                magic != "stereopointcounter-partial" || version != 1 ||
+                shardKey != "shard" || paramsKey != "params") {
+                error = paths[i] + " is not a partial result file";
+                ok = false;
+                break;
+            }
+            in->ignore(1);
+            if (params.empty()) {
+                params = p;
+                shardCount = count;
+            } else if (p != params || count != shardCount) {
+                error = paths[i] + " was written with different --shard "
+                        "count, --gridx, --gridy or --threshold";
+                ok = false;
+                break;
+            }
+            if (!shards.insert(index).second) {
+                std::ostringstream os;
+                os << "shard " << index << " given more than once";
+                error = os.str();
+                ok = false;
+                break;
+            }
+            // check up front that the shard finished so output is never
+            // written for an incomplete merge
+            std::string last;
+            double shardSeconds = 0.0;
+            int shardFailed = 0;
+            char key[16];
+            if (!readLastLine(paths[i], last) ||
+                sscanf(last.c_str(), "%15s %lf %d", key, &shardSeconds,
+                &shardFailed) != 3 || strcmp(key, "summary") != 0) {
+                error = paths[i] + " is incomplete, its shard did not finish";
+                ok = false;
+                break;
+            }
+            seconds += shardSeconds;
+            failed += shardFailed;
+        }
+        if (ok && (int) shards.size() != shardCount) {
+            std::ostringstream os;
+            os << "missing shards:";
+            for (int i = 0; i < shardCount; i++) {
+                if (shards.count(i) == 0) {
+                    os << " " << i << "/" << shardCount;
+                }
+            }
+            error = os.str();
+            ok = false;
+        }
+
+        long long totalPositive = 0;
+        long long total = 0;
+        if (ok) {
+            // k-way merge on row index
+            typedef std::pair<long, std::size_t> Head;
+            std::priority_queue<Head, std::vector<Head>,
+                    std::greater<Head> > heads;
+            std::vector<std::string> lines(inputs.size());
+            std::vector<int> positives(inputs.size());
+            std::vector<int> totals(inputs.size());
+            std::vector<std::size_t> csvStart(inputs.size());
+            for (std::size_t i = 0; i < inputs.size(); i++) {
+                long index;
+                if (readRow(*inputs[i], lines[i], index, positives[i],
+                        totals[i], csvStart[i])) {
+                    heads.push(Head(index, i));
+                }
+            }
+            out << "Image,GridSize,GridSizePixel,Positive,Total\n";
+            while (!heads.empty()) {
+                std::size_t i = heads.top().second;
+                heads.pop();
+                out.write(lines[i].data() + csvStart[i],
+                        lines[i].size() - csvStart[i]);
+                out << "\n";
+                totalPositive += positives[i];
+                total += totals[i];
+                long index;
+                if (readRow(*inputs[i], lines[i], index, positives[i],
+                        totals[i], csvStart[i])) {
+                    heads.push(Head(index, i));
+                }
+            }
+            out << "\nSeconds,GrandTotalPositive,GrandTotal,FailedImages\n";
+            out << seconds << "," << totalPositive << "," << total << ","
+                    << failed << std::endl;
+        }
+        for (std::size_t i = 0; i < inputs.size(); i++) {
+            delete inputs[i];
+        }
+        return ok;
+    }
+
+}
+
+#endif	/* PARTIALRESULT_HPP */
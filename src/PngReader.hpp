@@ -0,0 +1,338 @@
+/*
+ * File:   PngReader.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef PNGREADER_HPP
+#define	PNGREADER_HPP
+
+#include <stdio.h>
+#include <setjmp.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "itkImage.h"
+#include "itk_png.h"
+
+namespace spc {
+
+    /**
+     * Source of PNG bytes for PngReader when reading from memory
+     */
+    struct PngMemorySource {
+        const unsigned char *data;
+        std::size_t size;
+        std::size_t offset;
+    };
+
+    extern "C" inline void spcPngReadFromMemory(png_structp png,
+            png_bytep out, png_size_t length) {
+        PngMemorySource *source = (PngMemorySource *) png_get_io_ptr(png);
+        if (source->offset + length > source->size) {
+            png_error(png, "unexpected end of PNG data");
+        }
+        memcpy(out, source->data + source->offset, length);
+        source->offset += length;
+    }
+
+    /**
+     * libpng error handler that keeps the message for the exception instead
+     * of printing it
+     */
+    extern "C" inline void spcPngReadError(png_structp png,
+            png_const_charp msg) {
+        std::string *error = (std::string *) png_get_error_ptr(png);
+        *error = msg;
+        png_longjmp(png, 1);
+    }
+
+    /**
+     * libpng warning handler that drops warnings, they do not stop decoding
+     */
+    extern "C" inline void spcPngReadWarning(png_structp png,
+            png_const_charp msg) {
+        (void) png;
+        (void) msg;
+    }
+
+    /**
+     * @return true if data starts with the PNG signature
+     */
+    inline bool isPngSignature(const unsigned char *data, std::size_t size) {
+        return size >= 8 && png_sig_cmp((png_bytep) data, 0, 8) == 0;
+    }
+
+    /**
+     * Row oriented PNG decoder, the counterpart of PngWriter.  Reads from a
+     * file or from memory and always hands out 8-bit greyscale rows.
+     * Greyscale PNGs of up to 8 bits without transparency come out as
+     * itk::PNGImageIO would read them.  Palette, 16-bit, color and alpha
+     * PNGs are converted with libpng's transformations (expand, strip to 8
+     * bits, RGB to luminance, drop alpha), which do not match ITK's pixel
+     * conversion, see isGreyscale().  Non interlaced images can be read one
+     * row at a time so nothing larger than a row needs to exist in memory.
+     */
+    class PngReader {
+    public:
+
+        PngReader() : _fp(NULL), _png(NULL), _info(NULL), _width(0),
+        _height(0), _interlaced(false), _greyscale(false), _rowsLeft(0) {
+        }
+
+        virtual ~PngReader() {
+            destroy();
+        }
+
+        /**
+         * Opens path and reads the PNG header
+         * @param path input file
+         */
+        void open(const std::string& path) {
+            destroy();
+            _pngError.clear();
+            _name = path;
+            _fp = fopen(path.c_str(), "rb");
+            if (_fp == NULL) {
+                fail("Unable to open for reading");
+            }
+            unsigned char signature[8];
+            std::size_t numRead = fread(signature, 1, sizeof (signature), _fp);
+            if (!isPngSignature(signature, numRead)) {
+                fail("Not a PNG file");
+            }
+            create();
+            if (setjmp(png_jmpbuf(_png))) {
+                fail("libpng error reading header");
+            }
+            png_init_io(_png, _fp);
+            png_set_sig_bytes(_png, sizeof (signature));
+            readHeader();
+        }
+
+        /**
+         * Reads PNG header from memory
+         * @param data PNG file contents, must outlive the reader
+         * @param size number of bytes in data
+         * @param name used in error messages
+         */
+        void open(const unsigned char *data, std::size_t size,
+                const std::string& name) {
+            destroy();
+            _pngError.clear();
+            _name = name;
+            if (!isPngSignature(data, size)) {
+                fail("Not a PNG file");
+            }
+            _source.data = data;
+            _source.size = size;
+            _source.offset = 0;
+            create();
+            if (setjmp(png_jmpbuf(_png))) {
+                fail("libpng error reading header");
+            }
+            png_set_read_fn(_png, &_source, spcPngReadFromMemory);
+            readHeader();
+        }
+
+        int getWidth() const {
+            return _width;
+        }
+
+        int getHeight() const {
+            return _height;
+        }
+
+        /**
+         * @return bytes of the file or memory consumed by the decoder so far
+         */
+        std::size_t getBytesRead() const {
+            if (_fp != NULL) {
+                long offset = ftell(_fp);
+                return offset < 0 ? 0 : offset;
+            }
+            return _png != NULL ? _source.offset : 0;
+        }
+
+        /**
+         * @return true if the PNG is greyscale of up to 8 bits without
+         *         transparency, the only kind decoded to the same pixels as
+         *         ITK's readImage() gives.  Files of any other kind must be
+         *         decoded with readImage() so counts do not depend on which
+         *         path decoded them.
+         */
+        bool isGreyscale() const {
+            return _greyscale;
+        }
+
+        /**
+         * Interlaced images can only be decoded whole with readImage()
+         */
+        bool isInterlaced() const {
+            return _interlaced;
+        }
+
+        /**
+         * Decodes the next row of a non interlaced image
+         * @param row buffer of getWidth() bytes
+         */
+        void readRow(unsigned char *row) {
+            if (_png == NULL || _rowsLeft <= 0 || _interlaced) {
+                fail("readRow called on closed reader, past last row or on "
+                        "interlaced image");
+            }
+            if (setjmp(png_jmpbuf(_png))) {
+                fail("libpng error reading row");
+            }
+            png_read_row(_png, row, NULL);
+            _rowsLeft--;
+        }
+
+        /**
+         * Decodes the whole image
+         * @param buffer getWidth() * getHeight() bytes
+         */
+        void readImage(unsigned char *buffer) {
+            if (_png == NULL || _rowsLeft != _height) {
+                fail("readImage called on closed or partially read reader");
+            }
+            std::vector<png_bytep> rows(_height);
+            for (int y = 0; y < _height; y++) {
+                rows[y] = buffer + (std::size_t) y * _width;
+            }
+            if (setjmp(png_jmpbuf(_png))) {
+                fail("libpng error reading image");
+            }
+            if (_height > 0) {
+                png_read_image(_png, &rows[0]);
+            }
+            _rowsLeft = 0;
+        }
+
+        /**
+         * Releases decoder and closes file.  Remaining rows are not read.
+         */
+        void close() {
+            destroy();
+        }
+
+    private:
+        PngReader(const PngReader& orig);
+        PngReader& operator=(const PngReader& orig);
+
+        void create() {
+            _png = png_create_read_struct(PNG_LIBPNG_VER_STRING, &_pngError,
+                    spcPngReadError, spcPngReadWarning);
+            if (_png == NULL) {
+                fail("png_create_read_struct failed");
+            }
+            _info = png_create_info_struct(_png);
+            if (_info == NULL) {
+                fail("png_create_info_struct failed");
+            }
+        }
+
+        /**
+         * Reads header and sets up conversion to 8-bit greyscale, caller
+         * must have called setjmp
+         */
+        void readHeader() {
+            png_read_info(_png, _info);
+
+            int colorType = png_get_color_type(_png, _info);
+            _greyscale = colorType == PNG_COLOR_TYPE_GRAY &&
+                    png_get_bit_depth(_png, _info) <= 8 &&
+                    !png_get_valid(_png, _info, PNG_INFO_tRNS);
+            if (colorType == PNG_COLOR_TYPE_PALETTE) {
+                png_set_palette_to_rgb(_png);
+            }
+            if (colorType == PNG_COLOR_TYPE_GRAY &&
+                png_get_bit_depth(_png, _info) < 8) {
+                png_set_expand_gray_1_2_4_to_8(_png);
+            }
+            if (png_get_bit_depth(_png, _info) == 16) {
+                png_set_strip_16(_png);
+            }
+            if (colorType & PNG_COLOR_MASK_ALPHA) {
+                png_set_strip_alpha(_png);
+            }
+            if (colorType == PNG_COLOR_TYPE_PALETTE ||
+                (colorType & PNG_COLOR_MASK_COLOR)) {
+                png_set_rgb_to_gray_fixed(_png, 1, -1, -1);
+            }
+            _interlaced = png_set_interlace_handling(_png) > 1;
+            png_read_update_info(_png, _info);
+
+            _width = png_get_image_width(_png, _info);
+            _height = png_get_image_height(_png, _info);
+            _rowsLeft = _height;
+        }
+
+        void destroy() {
+            if (_png != NULL) {
+                png_destroy_read_struct(&_png, &_info, NULL);
+            }
+            _png = NULL;
+            _info = NULL;
+            if (_fp != NULL) {
+                fclose(_fp);
+            }
+            _fp = NULL;
+        }
+
+        void fail(const std::string& msg) {
+            destroy();
+            throw itk::ExceptionObject(__FILE__, __LINE__,
+                    msg + ": " + _name +
+                    (_pngError.empty() ? "" : ": " + _pngError),
+                    "spc::PngReader");
+        }
+
+        FILE *_fp;
+        png_structp _png;
+        png_infop _info;
+        PngMemorySource _source;
+        int _width;
+        int _height;
+        bool _interlaced;
+        bool _greyscale;
+        int _rowsLeft;
+        std::string _name;
+        std::string _pngError;
+    };
+
+    /**
+     * Decodes a PNG held in memory into an 8-bit greyscale image
+     * @param data PNG file contents
+     * @param size number of bytes in data
+     * @param name used in error messages
+     * @return decoded image
+     */
+    template < typename TImageType >
+    typename TImageType::Pointer readPngImage(const unsigned char *data,
+            std::size_t size, const std::string& name) {
+        PngReader reader;
+        reader.open(data, size, name);
+
+        typename TImageType::SizeType imageSize;
+        imageSize[0] = reader.getWidth();
+        imageSize[1] = reader.getHeight();
+        typename TImageType::IndexType start;
+        start[0] = 0;
+        start[1] = 0;
+        typename TImageType::RegionType region;
+        region.SetSize(imageSize);
+        region.SetIndex(start);
+
+        typename TImageType::Pointer image = TImageType::New();
+        image->SetRegions(region);
+        image->Allocate();
+        reader.readImage((unsigned char *) image->GetBufferPointer());
+        reader.close();
+        return image;
+    }
+}
+
+#endif	/* PNGREADER_HPP */
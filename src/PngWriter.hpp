@@ -0,0 +1,194 @@
+/*
+ * File:   PngWriter.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef PNGWRITER_HPP
+#define	PNGWRITER_HPP
+
+#include <stdio.h>
+#include <setjmp.h>
+
+#include <string>
+#include <vector>
+
+#include "itkImage.h"
+#include "itk_png.h"
+
+#include "StageTimer.hpp"
+
+namespace spc {
+
+    extern "C" inline void spcPngWriteToFile(png_structp png,
+            png_bytep data, png_size_t length) {
+        FILE *fp = (FILE *) png_get_io_ptr(png);
+        if (countedWrite(data, 1, length, fp) != length) {
+            png_error(png, "Write Error");
+        }
+    }
+
+    extern "C" inline void spcPngFlushFile(png_structp png) {
+        fflush((FILE *) png_get_io_ptr(png));
+    }
+
+    /**
+     * Row oriented PNG encoder.  Unlike itk::ImageFileWriter this lets the
+     * caller pick the PNG color type (palette, 1-bit greyscale, etc) and
+     * hand over the image one row at a time so nothing larger than a row
+     * needs to exist in memory.
+     */
+    class PngWriter {
+    public:
+
+        enum ColorType {
+            GREY, GREY_1BIT, RGB, PALETTE
+        };
+
+        PngWriter() : _fp(NULL), _png(NULL), _info(NULL), _rowsLeft(0) {
+        }
+
+        virtual ~PngWriter() {
+            destroy();
+        }
+
+        /**
+         * Opens path and writes the PNG header
+         * @param path output file
+         * @param width image width in pixels
+         * @param height image height in pixels
+         * @param colorType layout of rows passed to writeRow().  GREY_1BIT
+         *        rows are packed 8 pixels per byte, most significant bit
+         *        first.
+         * @param palette r,g,b triplets, required for PALETTE (max 256)
+         */
+        void open(const std::string& path, int width, int height,
+                ColorType colorType,
+                const std::vector<itk::RGBPixel<unsigned char> > *palette = NULL) {
+            destroy();
+            _path = path;
+            _fp = fopen(path.c_str(), "wb");
+            if (_fp == NULL) {
+                fail("Unable to open for writing");
+            }
+            _png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+            if (_png == NULL) {
+                fail("png_create_write_struct failed");
+            }
+            _info = png_create_info_struct(_png);
+            if (_info == NULL) {
+                fail("png_create_info_struct failed");
+            }
+            std::vector<png_color> colors;
+            if (colorType == PALETTE) {
+                if (palette == NULL || palette->empty() || palette->size() > 256) {
+                    fail("Palette PNG requires 1 - 256 palette entries");
+                }
+                colors.resize(palette->size());
+                for (std::size_t i = 0; i < palette->size(); i++) {
+                    colors[i].red = (*palette)[i].GetRed();
+                    colors[i].green = (*palette)[i].GetGreen();
+                    colors[i].blue = (*palette)[i].GetBlue();
+                }
+            }
+            if (setjmp(png_jmpbuf(_png))) {
+                fail("libpng error writing header");
+            }
+            // written through countedWrite() so file writes are timed
+            png_set_write_fn(_png, _fp, spcPngWriteToFile, spcPngFlushFile);
+
+            int pngColorType = PNG_COLOR_TYPE_GRAY;
+            int bitDepth = 8;
+            if (colorType == GREY_1BIT) {
+                bitDepth = 1;
+            } else if (colorType == RGB) {
+                pngColorType = PNG_COLOR_TYPE_RGB;
+            } else if (colorType == PALETTE) {
+                pngColorType = PNG_COLOR_TYPE_PALETTE;
+            }
+            png_set_IHDR(_png, _info, width, height, bitDepth, pngColorType,
+                    PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                    PNG_FILTER_TYPE_DEFAULT);
+
+            // row filters rarely pay off for indexed or bilevel data
+            if (colorType == PALETTE || colorType == GREY_1BIT) {
+                png_set_filter(_png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+            }
+            if (colorType == PALETTE) {
+                png_set_PLTE(_png, _info, &colors[0], colors.size());
+            }
+            png_write_info(_png, _info);
+            _rowsLeft = height;
+        }
+
+        /**
+         * Encodes the next row of the image
+         * @param row pixel data laid out per the ColorType passed to open()
+         */
+        void writeRow(const unsigned char *row) {
+            if (_png == NULL || _rowsLeft <= 0) {
+                fail("writeRow called on closed writer or past last row");
+            }
+            if (setjmp(png_jmpbuf(_png))) {
+                fail("libpng error writing row");
+            }
+            png_write_row(_png, const_cast<png_bytep> (row));
+            _rowsLeft--;
+        }
+
+        /**
+         * Finishes the PNG stream and closes the file.  All rows must have
+         * been written.
+         */
+        void close() {
+            if (_png == NULL) {
+                return;
+            }
+            if (_rowsLeft != 0) {
+                fail("close called before all rows were written");
+            }
+            if (setjmp(png_jmpbuf(_png))) {
+                fail("libpng error finishing image");
+            }
+            png_write_end(_png, NULL);
+            png_destroy_write_struct(&_png, &_info);
+            _png = NULL;
+            _info = NULL;
+            int rc = countedClose(_fp);
+            _fp = NULL;
+            if (rc != 0) {
+                fail("Error closing file");
+            }
+        }
+
+    private:
+        PngWriter(const PngWriter& orig);
+        PngWriter& operator=(const PngWriter& orig);
+
+        void destroy() {
+            if (_png != NULL) {
+                png_destroy_write_struct(&_png, &_info);
+            }
+            _png = NULL;
+            _info = NULL;
+            if (_fp != NULL) {
+                fclose(_fp);
+            }
+            _fp = NULL;
+        }
+
+        void fail(const std::string& msg) {
+            destroy();
+            throw itk::ExceptionObject(__FILE__, __LINE__,
+                    msg + ": " + _path, "spc::PngWriter");
+        }
+
+        FILE *_fp;
+        png_structp _png;
+        png_infop _info;
+        int _rowsLeft;
+        std::string _path;
+    };
+}
+
+#endif	/* PNGWRITER_HPP */
@@ -0,0 +1,154 @@
+/*
+ * File:   Reanalysis.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef REANALYSIS_HPP
+#define	REANALYSIS_HPP
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+
+#include "ImageUtils.hpp"
+#include "IntersectionValues.hpp"
+#include "OutputBuffer.hpp"
+
+namespace spc {
+
+    /**
+     * Counts the intersections of a record that are >= threshold, using
+     * every stepX-th grid column and every stepY-th grid row
+     * @param total set to number of intersections used
+     * @return number of intersections >= threshold
+     */
+    inline std::size_t countRecord(const IntersectionRecord& record,
+            int threshold, int stepX, int stepY, std::size_t &total) {
+        std::size_t columns = record.header->columns;
+        std::size_t rows = record.header->rows;
+        total = (columns / stepX) * (rows / stepY);
+        if (stepX == 1 && stepY == 1) {
+            return countAtOrAboveThreshold(record.values, columns * rows,
+                    threshold);
+        }
+        std::size_t positive = 0;
+        for (std::size_t r = stepY - 1; r < rows; r += stepY) {
+            const unsigned char *row = record.values + r * columns;
+            if (stepX == 1) {
+                positive += countAtOrAboveThreshold(row, columns, threshold);
+                continue;
+            }
+            for (std::size_t c = stepX - 1; c < columns; c += stepX) {
+                positive += row[c] >= threshold;
+            }
+        }
+        return positive;
+    }
+
+    /**
+     * Writes the CSV and summary a run over the images would have written,
+     * computed from files written with --savevalues instead of the images.
+     * A coarser grid than the stored one uses every k-th stored grid line,
+     * where k is stored gridx / gridx (and likewise for y), so grid lines
+     * are k times the stored pixel spacing apart.  Records of an image
+     * repeated by a resumed run are only counted once.  Seconds is the
+     * time taken by the reanalysis.  FailedImages is left empty: values
+     * files only hold the images that were read, so how many failed is not
+     * known.
+     * @param paths files written with --savevalues
+     * @param threshold
+     * @param gridX 0 for the stored grid, otherwise a divisor of the stored
+     *        gridx
+     * @param gridY 0 for the stored grid, otherwise a divisor of the stored
+     *        gridy
+     * @param out where output is written
+     * @param error set to reason upon failure
+     * @return false if a file is unreadable or gridX or gridY does not
+     *         divide the stored grid, nothing is written then
+     */
+    inline bool reanalyzeIntersectionValues(
+            const std::vector<std::string>& paths, int threshold, int gridX,
+            int gridY, OutputBuffer& out, std::string& error) {
+        std::chrono::steady_clock::time_point startTime =
+                std::chrono::steady_clock::now();
+        std::vector<IntersectionValueReader *> readers;
+        bool ok = true;
+        for (std::size_t i = 0; i < paths.size() && ok; i++) {
+            readers.push_back(new IntersectionValueReader());
+            if (!readers[i]->open(paths[i], error)) {
+                error = paths[i] + ": " + error;
+                ok = false;
+                break;
+            }
+            for (std::size_t j = 0; j < readers[i]->getNumRecords(); j++) {
+                const IntersectionRecordHeader *header =
+                        readers[i]->getRecord(j).header;
+                if ((gridX > 0 && (header->gridX < gridX ||
+                    header->gridX % gridX != 0)) ||
+                    (gridY > 0 && (header->gridY < gridY ||
+                    header->gridY % gridY != 0))) {
+                    std::ostringstream os;
+                    os << paths[i] << " has a " << header->gridX << "x"
+                            << header->gridY << " grid which --gridx and "
+                            "--gridy must divide";
+                    error = os.str();
+                    ok = false;
+                    break;
+                }
+            }
+        }
+
+        long long totalPositive = 0;
+        long long total = 0;
+        if (ok) {
+            std::unordered_set<std::string> seen;
+            LineBuilder line;
+            out.write("Image,GridSize,GridSizePixel,Positive,Total\n");
+            for (std::size_t i = 0; i < readers.size(); i++) {
+                for (std::size_t j = 0; j < readers[i]->getNumRecords(); j++) {
+                    IntersectionRecord record = readers[i]->getRecord(j);
+                    const IntersectionRecordHeader *header = record.header;
+                    std::string path(record.path, header->pathBytes);
+                    if (!seen.insert(path).second) {
+                        continue;
+                    }
+                    int stepX = gridX > 0 ? header->gridX / gridX : 1;
+                    int stepY = gridY > 0 ? header->gridY / gridY : 1;
+                    std::size_t imageTotal;
+                    std::size_t positive = countRecord(record, threshold,
+                            stepX, stepY, imageTotal);
+                    line.clear();
+                    line.append(path).append(',')
+                            .append(header->gridX / stepX).append('x')
+                            .append(header->gridY / stepY).append(',')
+                            .append(header->gridWidth * stepX).append('x')
+                            .append(header->gridHeight * stepY).append(',')
+                            .append((long long) positive).append(',')
+                            .append((long long) imageTotal);
+                    out.writeLine(line);
+                    totalPositive += positive;
+                    total += imageTotal;
+                }
+            }
+            std::chrono::duration<double> elapsed =
+                    std::chrono::steady_clock::now() - startTime;
+            out.write("\nSeconds,GrandTotalPositive,GrandTotal,FailedImages\n");
+            line.clear();
+            line.append(elapsed.count()).append(',').append(totalPositive)
+                    .append(',').append(total).append(',');
+            out.writeLine(line);
+        }
+        for (std::size_t i = 0; i < readers.size(); i++) {
+            delete readers[i];
+        }
+        return ok;
+    }
+}
+
+#endif	/* REANALYSIS_HPP */
@@ -0,0 +1,389 @@
+/*
+ * File:   ResultCache.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef RESULTCACHE_HPP
+#define	RESULTCACHE_HPP
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace spc {
+
+    /**
+     * 64-bit FNV-1a hash
+     * @param data bytes to hash
+     * @param len number of bytes
+     * @param hash value to continue from, pass result of a previous call to
+     *        hash data in pieces
+     * @return hash
+     */
+    inline uint64_t fnv1a64(const void *data, std::size_t len,
+            uint64_t hash = 14695981039346656037ULL) {
+        const unsigned char *bytes = (const unsigned char *) data;
+        for (std::size_t i = 0; i < len; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    /**
+     * Hashes contents of file
+     * @param path file to hash
+     * @param hash set to hash of contents
+     * @return false if file could not be read
+     */
+    bool hashFileContents(const std::string& path, uint64_t &hash) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        std::vector<unsigned char> buffer(1 << 16);
+        hash = fnv1a64(NULL, 0);
+        ssize_t numRead;
+        while ((numRead = read(fd, &buffer[0], buffer.size())) > 0) {
+            hash = fnv1a64(&buffer[0], numRead, hash);
+        }
+        close(fd);
+        return numRead == 0;
+    }
+
+    /**
+     * Per image values stored in the cache
+     */
+    struct CachedResult {
+        int gridWidth;
+        int gridHeight;
+        int positive;
+        int total;
+    };
+
+    /**
+     * Append-only on-disk cache of per image results keyed by image path,
+     * file size, modification time, optional content hash and the
+     * gridx, gridy and threshold used.
+     *
+     * The file is a 16 byte header followed by fixed size records.  Records
+     * are only ever appended, each with a single O_APPEND write under an
+     * exclusive flock, so several processes can share one cache file.  A
+     * later record for the same key supersedes earlier ones and records
+     * with a bad checksum (torn writes) are ignored.
+     *
+     * Existing records are memory mapped on open and indexed with an open
+     * addressing hash table of 4 byte slots, so lookups are O(1) and 10M
+     * entries cost ~80 MB of index.
+     */
+    class ResultCache {
+    public:
+
+        ResultCache() : _fd(-1), _map(NULL), _mapBytes(0), _numMapped(0),
+        _numUsed(0), _useContentHash(false) {
+        }
+
+        virtual ~ResultCache() {
+            if (_map != NULL) {
+                munmap(_map, _mapBytes);
+            }
+            if (_fd >= 0) {
+                close(_fd);
+            }
+        }
+
+        /**
+         * Opens cache file creating it if needed
+         * @param path cache file
+         * @param useContentHash if true a hash of the image file contents
+         *        must also match for a cache hit
+         * @param error set to reason upon failure
+         * @return false if cache could not be opened
+         */
+        bool open(const std::string& path, bool useContentHash,
+                std::string& error) {
+            _useContentHash = useContentHash;
+            _fd = ::open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+                    0644);
+            if (_fd < 0) {
+                error = strerror(errno);
+                return false;
+            }
+            flock(_fd, LOCK_EX);
+            struct stat st;
+            bool ok = fstat(_fd, &st) == 0;
+            if (ok && st.st_size == 0) {
+                ok = writeHeader();
+                st.st_size = HEADER_BYTES;
+            } else if (ok) {
+                ok = checkHeader();
+                // drop partial record left by a writer that crashed so
+                // appends stay aligned
+                off_t extra = (st.st_size - HEADER_BYTES) % sizeof (Record);
+                if (ok && extra != 0) {
+                    st.st_size -= extra;
+                    ok = ftruncate(_fd, st.st_size) == 0;
+                }
+            }
+            flock(_fd, LOCK_UN);
+            if (!ok) {
+                error = "not a stereopointcounter cache file";
+                return false;
+            }
+
+            _numMapped = (st.st_size - HEADER_BYTES) / sizeof (Record);
+            if (_numMapped > 0) {
+                _mapBytes = HEADER_BYTES + _numMapped * sizeof (Record);
+                void *map = mmap(NULL, _mapBytes, PROT_READ, MAP_SHARED,
+                        _fd, 0);
+                if (map == MAP_FAILED) {
+                    error = strerror(errno);
+                    return false;
+                }
+                _map = map;
+            }
+            rehash(nextPowerOfTwo(2 * _numMapped + 1024));
+            for (std::size_t i = 0; i < _numMapped; i++) {
+                if (mappedRecord(i).checksum == checksum(mappedRecord(i))) {
+                    insert(i);
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Looks up image
+         * @param path path of image
+         * @param gridX
+         * @param gridY
+         * @param threshold
+         * @param result set to cached values on hit
+         * @return true on hit
+         */
+        bool lookup(const std::string& path, int gridX, int gridY,
+                int threshold, CachedResult &result) {
+            Record want;
+            // always stat (and hash) again, the file may have been rewritten
+            // since it was last seen
+            _lastPath.clear();
+            if (!makeRecord(path, gridX, gridY, threshold, want)) {
+                return false;
+            }
+            _lastPath = path;
+            _lastRecord = want;
+            std::size_t slot = findSlot(want.key);
+            if (_slots[slot] == 0) {
+                return false;
+            }
+            const Record &r = recordAt(_slots[slot] - 1);
+            if (r.pathHash != want.pathHash || r.size != want.size ||
+                r.mtimeNs != want.mtimeNs ||
+                r.contentHash != want.contentHash || r.gridX != gridX ||
+                r.gridY != gridY || r.threshold != threshold) {
+                return false;
+            }
+            result.gridWidth = r.gridWidth;
+            result.gridHeight = r.gridHeight;
+            result.positive = r.positive;
+            result.total = r.total;
+            return true;
+        }
+
+        /**
+         * Appends result for image to the cache file
+         * @return false if file could not be stat'ed or written
+         */
+        bool store(const std::string& path, int gridX, int gridY,
+                int threshold, const CachedResult &result) {
+            Record r;
+            // store() normally follows lookup() of same image, reuse the
+            // stat and content hash that lookup() just made, once
+            if (path == _lastPath && gridX == _lastRecord.gridX &&
+                gridY == _lastRecord.gridY &&
+                threshold == _lastRecord.threshold) {
+                r = _lastRecord;
+            } else if (!makeRecord(path, gridX, gridY, threshold, r)) {
+                return false;
+            }
+            _lastPath.clear();
+            r.gridWidth = result.gridWidth;
+            r.gridHeight = result.gridHeight;
+            r.positive = result.positive;
+            r.total = result.total;
+            r.checksum = checksum(r);
+
+            flock(_fd, LOCK_EX);
+            bool ok = write(_fd, &r, sizeof (r)) == (ssize_t) sizeof (r);
+            flock(_fd, LOCK_UN);
+            if (ok) {
+                _added.push_back(r);
+                insert(_numMapped + _added.size() - 1);
+            }
+            return ok;
+        }
+
+    private:
+        ResultCache(const ResultCache& orig);
+        ResultCache& operator=(const ResultCache& orig);
+
+        struct Record {
+            uint64_t key;
+            uint64_t pathHash;
+            int64_t size;
+            int64_t mtimeNs;
+            uint64_t contentHash;
+            int32_t gridX;
+            int32_t gridY;
+            int32_t threshold;
+            int32_t gridWidth;
+            int32_t gridHeight;
+            int32_t positive;
+            int32_t total;
+            uint32_t checksum;
+        };
+
+        static_assert(sizeof (Record) == 72, "cache record must be packed");
+
+        static const std::size_t HEADER_BYTES = 16;
+
+        static uint32_t checksum(const Record &r) {
+            uint64_t h = fnv1a64(&r, offsetof(Record, checksum));
+            return (uint32_t) (h ^ (h >> 32));
+        }
+
+        static std::size_t nextPowerOfTwo(std::size_t n) {
+            std::size_t p = 1;
+            while (p < n) {
+                p <<= 1;
+            }
+            return p;
+        }
+
+        bool writeHeader() {
+            char header[HEADER_BYTES];
+            memset(header, 0, sizeof (header));
+            memcpy(header, "SPCCACHE", 8);
+            uint32_t version = 1;
+            uint32_t recordBytes = sizeof (Record);
+            memcpy(header + 8, &version, 4);
+            memcpy(header + 12, &recordBytes, 4);
+            return write(_fd, header, sizeof (header)) ==
+                    (ssize_t) sizeof (header);
+        }
+
+        bool checkHeader() {
+            char header[HEADER_BYTES];
+            if (pread(_fd, header, sizeof (header), 0) !=
+                (ssize_t) sizeof (header)) {
+                return false;
+            }
+            uint32_t version;
+            uint32_t recordBytes;
+            memcpy(&version, header + 8, 4);
+            memcpy(&recordBytes, header + 12, 4);
+            return memcmp(header, "SPCCACHE", 8) == 0 && version == 1 &&
+                    recordBytes == sizeof (Record);
+        }
+
+        bool makeRecord(const std::string& path, int gridX, int gridY,
+                int threshold, Record &r) {
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) {
+                return false;
+            }
+            memset(&r, 0, sizeof (r));
+            r.gridX = gridX;
+            r.gridY = gridY;
+            r.threshold = threshold;
+            r.size = st.st_size;
+#if defined(__APPLE__)
+            r.mtimeNs = st.st_mtimespec.tv_sec * 1000000000LL +
+                    st.st_mtimespec.tv_nsec;
+#else
+            r.mtimeNs = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+            if (_useContentHash && !hashFileContents(path, r.contentHash)) {
+                return false;
+            }
+            uint64_t key = fnv1a64(path.data(), path.length());
+            int32_t params[3] = {gridX, gridY, threshold};
+            r.key = fnv1a64(params, sizeof (params), key);
+            // second hash seeded differently guards against key collisions
+            r.pathHash = fnv1a64(path.data(), path.length(),
+                    0x9e3779b97f4a7c15ULL);
+            return true;
+        }
+
+        const Record &mappedRecord(std::size_t i) const {
+            return ((const Record *) ((const char *) _map + HEADER_BYTES))[i];
+        }
+
+        const Record &recordAt(std::size_t i) const {
+            if (i < _numMapped) {
+                return mappedRecord(i);
+            }
+            return _added[i - _numMapped];
+        }
+
+        std::size_t findSlot(uint64_t key) const {
+            std::size_t mask = _slots.size() - 1;
+            std::size_t slot = (key ^ (key >> 29)) & mask;
+            while (_slots[slot] != 0 && recordAt(_slots[slot] - 1).key != key) {
+                slot = (slot + 1) & mask;
+            }
+            return slot;
+        }
+
+        void insert(std::size_t index) {
+            if (2 * (_numUsed + 1) > _slots.size()) {
+                rehash(_slots.size() * 2);
+            }
+            std::size_t slot = findSlot(recordAt(index).key);
+            if (_slots[slot] == 0) {
+                _numUsed++;
+            }
+            _slots[slot] = index + 1;
+        }
+
+        void rehash(std::size_t numSlots) {
+            std::vector<uint32_t> old;
+            old.swap(_slots);
+            _slots.assign(numSlots, 0);
+            for (std::size_t i = 0; i < old.size(); i++) {
+                if (old[i] != 0) {
+                    _slots[findSlot(recordAt(old[i] - 1).key)] = old[i];
+                }
+            }
+        }
+
+        int _fd;
+        void *_map;
+        std::size_t _mapBytes;
+        std::size_t _numMapped;
+        std::vector<Record> _added;
+
+        // record index + 1 for each slot, 0 if empty
+        std::vector<uint32_t> _slots;
+        std::size_t _numUsed;
+        bool _useContentHash;
+
+        /**
+         * Path and record of the last lookup(), until store() uses them
+         */
+        std::string _lastPath;
+        Record _lastRecord;
+    };
+}
+
+#endif	/* RESULTCACHE_HPP */
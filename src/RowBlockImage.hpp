@@ -0,0 +1,530 @@
+/*
+ * File:   RowBlockImage.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef ROWBLOCKIMAGE_HPP
+#define	ROWBLOCKIMAGE_HPP
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+#include "itkImage.h"
+
+namespace spc {
+
+    /**
+     * Writes the 255, 255, ..., remainder encoding of an LZ4 length
+     */
+    inline void lz4WriteLength(std::size_t length,
+            std::vector<unsigned char> &out) {
+        for (; length >= 255; length -= 255) {
+            out.push_back(255);
+        }
+        out.push_back((unsigned char) length);
+    }
+
+    /**
+     * Compresses data in the LZ4 block format (greedy matching on a hash
+     * of 4 byte sequences), which decodes at several GB/s
+     * @param table scratch space kept between calls
+     * @param out set to compressed data
+     */
+    inline void lz4Compress(const unsigned char *data, std::size_t n,
+            std::vector<uint32_t> &table, std::vector<unsigned char> &out) {
+        static const std::size_t HASH_BITS = 14;
+        // the format requires the last 5 bytes to be literals and the last
+        // match to start at least 12 bytes before the end
+        static const std::size_t LAST_LITERALS = 5;
+        static const std::size_t MATCH_LIMIT = 12;
+        table.assign((std::size_t) 1 << HASH_BITS, 0);
+        out.clear();
+        out.reserve(n + n / 255 + 16);
+        std::size_t anchor = 0;
+        std::size_t i = 0;
+        while (n > MATCH_LIMIT && i < n - MATCH_LIMIT) {
+            uint32_t sequence;
+            memcpy(&sequence, data + i, 4);
+            uint32_t hash = (sequence * 2654435761U) >> (32 - HASH_BITS);
+            // positions are stored plus one so 0 means empty
+            std::size_t candidate = table[hash];
+            table[hash] = i + 1;
+            bool found = false;
+            if (candidate != 0 && i - (candidate - 1) <= 65535) {
+                uint32_t previous;
+                memcpy(&previous, data + candidate - 1, 4);
+                found = previous == sequence;
+            }
+            if (!found) {
+                i++;
+                continue;
+            }
+            std::size_t match = candidate - 1;
+            std::size_t length = 4;
+            std::size_t maxLength = n - LAST_LITERALS - i;
+            while (length < maxLength && data[match + length] ==
+                    data[i + length]) {
+                length++;
+            }
+            std::size_t literals = i - anchor;
+            std::size_t extra = length - 4;
+            out.push_back((unsigned char) (((literals < 15 ? literals : 15)
+                    << 4) | (extra < 15 ? extra : 15)));
+            if (literals >= 15) {
+                lz4WriteLength(literals - 15, out);
+            }
+            out.insert(out.end(), data + anchor, data + i);
+            std::size_t offset = i - match;
+            out.push_back((unsigned char) (offset & 0xff));
+            out.push_back((unsigned char) (offset >> 8));
+            if (extra >= 15) {
+                lz4WriteLength(extra - 15, out);
+            }
+            i += length;
+            anchor = i;
+        }
+        std::size_t literals = n - anchor;
+        out.push_back((unsigned char) ((literals < 15 ? literals : 15) << 4));
+        if (literals >= 15) {
+            lz4WriteLength(literals - 15, out);
+        }
+        out.insert(out.end(), data + anchor, data + n);
+    }
+
+    /**
+     * Reads an LZ4 length continuation
+     * @return false if data ends first
+     */
+    inline bool lz4ReadLength(const unsigned char *data, std::size_t len,
+            std::size_t &i, std::size_t &length) {
+        unsigned char byte;
+        do {
+            if (i >= len) {
+                return false;
+            }
+            byte = data[i++];
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    /**
+     * Decompresses an LZ4 block, every length and offset is bounds checked
+     * @param dest buffer of n bytes
+     * @return false unless data decodes to exactly n bytes
+     */
+    inline bool lz4Decompress(const unsigned char *data, std::size_t len,
+            unsigned char *dest, std::size_t n) {
+        std::size_t i = 0;
+        std::size_t o = 0;
+        while (i < len) {
+            unsigned int token = data[i++];
+            std::size_t literals = token >> 4;
+            if (literals == 15 && !lz4ReadLength(data, len, i, literals)) {
+                return false;
+            }
+            if (literals > len - i || literals > n - o) {
+                return false;
+            }
+            memcpy(dest + o, data + i, literals);
+            i += literals;
+            o += literals;
+            if (i == len) {
+                break;
+            }
+            if (len - i < 2) {
+                return false;
+            }
+            std::size_t offset = data[i] | (data[i + 1] << 8);
+            i += 2;
+            std::size_t length = token & 15;
+            if (length == 15 && !lz4ReadLength(data, len, i, length)) {
+                return false;
+            }
+            length += 4;
+            if (offset == 0 || offset > o || length > n - o) {
+                return false;
+            }
+            unsigned char *to = dest + o;
+            const unsigned char *from = to - offset;
+            if (offset >= length) {
+                memcpy(to, from, length);
+            } else {
+                // overlapping match repeats the last offset bytes
+                for (std::size_t k = 0; k < length; k++) {
+                    to[k] = from[k];
+                }
+            }
+            o += length;
+        }
+        return o == n;
+    }
+
+    /**
+     * Header at offset 0 of a row block (.spr) image.  It is followed by
+     * numBlocks + 1 uint64 file offsets, block b being the bytes from
+     * offset b to offset b + 1, and then the blocks.  Block b holds rows
+     * b * rowsPerBlock up to the next block's first row as 8-bit pixels,
+     * LZ4 compressed unless that is not smaller, in which case it is stored
+     * as is.  Values are in native (little endian) byte order.
+     */
+    struct RowBlockHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrderMark;
+        int32_t width;
+        int32_t height;
+        int32_t rowsPerBlock;
+        uint32_t numBlocks;
+    };
+
+    static_assert(sizeof (RowBlockHeader) == 32, "header must be packed");
+
+    const char ROW_BLOCK_MAGIC[8] = {'S', 'P', 'C', 'R', 'O', 'W', 'S', '\0'};
+    const uint32_t ROW_BLOCK_BYTE_ORDER_MARK = 0x01020304;
+
+    /**
+     * @return true if data starts with the row block image magic
+     */
+    inline bool isRowBlockSignature(const unsigned char *data,
+            std::size_t size) {
+        return size >= 8 && memcmp(data, ROW_BLOCK_MAGIC, 8) == 0;
+    }
+
+    /**
+     * Writes an 8-bit greyscale image as a row block (.spr) file one row
+     * at a time.  The file is written as <path>.part and only renamed to
+     * path by close(), so a failed or abandoned write leaves nothing
+     * behind.
+     */
+    class RowBlockWriter {
+    public:
+
+        RowBlockWriter() : _fp(NULL), _width(0), _rowsPerBlock(0),
+        _rowsInBlock(0), _offset(0) {
+        }
+
+        virtual ~RowBlockWriter() {
+            discard();
+        }
+
+        /**
+         * @param path output file
+         * @param width image width in pixels
+         * @param height image height in pixels
+         * @param rowsPerBlock rows compressed together, smaller blocks make
+         *        reading a single row cheaper
+         */
+        void open(const std::string& path, int width, int height,
+                int rowsPerBlock) {
+            discard();
+            _path = path;
+            _partPath = path + ".part";
+            _fp = fopen(_partPath.c_str(), "wb");
+            if (_fp == NULL) {
+                fail("Unable to open for writing");
+            }
+            RowBlockHeader header;
+            memset(&header, 0, sizeof (header));
+            memcpy(header.magic, ROW_BLOCK_MAGIC, sizeof (header.magic));
+            header.version = 1;
+            header.byteOrderMark = ROW_BLOCK_BYTE_ORDER_MARK;
+            header.width = width;
+            header.height = height;
+            header.rowsPerBlock = rowsPerBlock;
+            header.numBlocks = (height + rowsPerBlock - 1) / rowsPerBlock;
+            _width = width;
+            _rowsPerBlock = rowsPerBlock;
+            _rowsInBlock = 0;
+            _block.resize((std::size_t) width * rowsPerBlock);
+            _offsets.clear();
+            _offsets.reserve(header.numBlocks + 1);
+            // block offsets are filled in by close()
+            std::vector<uint64_t> table(header.numBlocks + 1, 0);
+            if (fwrite(&header, sizeof (header), 1, _fp) != 1 ||
+                fwrite(&table[0], sizeof (uint64_t), table.size(), _fp) !=
+                table.size()) {
+                fail("Error writing");
+            }
+            _offset = sizeof (header) + table.size() * sizeof (uint64_t);
+        }
+
+        /**
+         * @param row width 8-bit pixels
+         */
+        void writeRow(const unsigned char *row) {
+            memcpy(&_block[(std::size_t) _rowsInBlock * _width], row, _width);
+            if (++_rowsInBlock == _rowsPerBlock) {
+                writeBlock();
+            }
+        }
+
+        /**
+         * Writes last block and block offsets and closes file.  All rows
+         * must have been written.
+         */
+        void close() {
+            if (_rowsInBlock > 0) {
+                writeBlock();
+            }
+            _offsets.push_back(_offset);
+            bool ok = fseeko(_fp, sizeof (RowBlockHeader), SEEK_SET) == 0 &&
+                    fwrite(&_offsets[0], sizeof (uint64_t), _offsets.size(),
+                    _fp) == _offsets.size();
+            ok = fclose(_fp) == 0 && ok;
+            _fp = NULL;
+            if (!ok || rename(_partPath.c_str(), _path.c_str()) != 0) {
+                fail("Error writing");
+            }
+            _partPath.clear();
+        }
+
+    private:
+        RowBlockWriter(const RowBlockWriter& orig);
+        RowBlockWriter& operator=(const RowBlockWriter& orig);
+
+        void writeBlock() {
+            std::size_t rawBytes = (std::size_t) _rowsInBlock * _width;
+            lz4Compress(_block.empty() ? NULL : &_block[0], rawBytes, _table,
+                    _compressed);
+            const unsigned char *data = _block.empty() ? NULL : &_block[0];
+            std::size_t len = rawBytes;
+            if (_compressed.size() < rawBytes) {
+                data = &_compressed[0];
+                len = _compressed.size();
+            }
+            if (len > 0 && fwrite(data, 1, len, _fp) != len) {
+                fail("Error writing");
+            }
+            _offsets.push_back(_offset);
+            _offset += len;
+            _rowsInBlock = 0;
+        }
+
+        /**
+         * Closes and removes a file not completed by close()
+         */
+        void discard() {
+            if (_fp != NULL) {
+                fclose(_fp);
+                _fp = NULL;
+            }
+            if (!_partPath.empty()) {
+                unlink(_partPath.c_str());
+                _partPath.clear();
+            }
+        }
+
+        void fail(const std::string& msg) {
+            discard();
+            throw itk::ExceptionObject(__FILE__, __LINE__, msg + ": " + _path,
+                    "spc::RowBlockWriter");
+        }
+
+        FILE *_fp;
+        std::string _path;
+        std::string _partPath;
+        int _width;
+        int _rowsPerBlock;
+        int _rowsInBlock;
+        uint64_t _offset;
+        std::vector<uint64_t> _offsets;
+        std::vector<unsigned char> _block;
+        std::vector<unsigned char> _compressed;
+        std::vector<uint32_t> _table;
+    };
+
+    /**
+     * Memory maps a row block (.spr) image.  Any row can be read by
+     * decoding only the block holding it, the most recently decoded block
+     * is kept so reading rows in order decodes each block once.
+     */
+    class RowBlockReader {
+    public:
+
+        RowBlockReader() : _map(NULL), _mapBytes(0), _header(NULL),
+        _offsets(NULL), _cachedBlock(-1), _bytesRead(0) {
+        }
+
+        virtual ~RowBlockReader() {
+            if (_map != NULL) {
+                munmap(_map, _mapBytes);
+            }
+        }
+
+        /**
+         * Maps path and checks its header and block offsets
+         */
+        void open(const std::string& path) {
+            _path = path;
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                fail(std::string("Unable to open for reading: ") +
+                        strerror(errno));
+            }
+            _mapBytes = st.st_size;
+            if (_mapBytes > 0) {
+                _map = mmap(NULL, _mapBytes, PROT_READ, MAP_SHARED, fd, 0);
+            }
+            ::close(fd);
+            if (_map == MAP_FAILED || _map == NULL) {
+                _map = NULL;
+                fail("Unable to map file");
+            }
+            _header = (const RowBlockHeader *) _map;
+            if (_mapBytes < sizeof (*_header) ||
+                !isRowBlockSignature((const unsigned char *) _map,
+                _mapBytes) || _header->version != 1 ||
+                _header->byteOrderMark != ROW_BLOCK_BYTE_ORDER_MARK ||
+                _header->width < 0 || _header->height < 0 ||
+                _header->rowsPerBlock <= 0 || _header->numBlocks !=
+                ((uint64_t) _header->height + _header->rowsPerBlock - 1) /
+                _header->rowsPerBlock || (uint64_t) _header->numBlocks + 1 >
+                (_mapBytes - sizeof (*_header)) / sizeof (uint64_t)) {
+                fail("Not a row block image, truncated or wrong byte order");
+            }
+            _offsets = (const uint64_t *) ((const char *) _map +
+                    sizeof (*_header));
+            uint64_t start = sizeof (*_header) +
+                    ((uint64_t) _header->numBlocks + 1) * sizeof (uint64_t);
+            for (uint32_t b = 0; b <= _header->numBlocks; b++) {
+                if (_offsets[b] < start || _offsets[b] > _mapBytes ||
+                    (b < _header->numBlocks && (_offsets[b + 1] < _offsets[b]
+                    || _offsets[b + 1] - _offsets[b] > blockBytes(b)))) {
+                    fail("Row block image is truncated or corrupt");
+                }
+            }
+            _cachedBlock = -1;
+            _bytesRead = start;
+        }
+
+        int getWidth() const {
+            return _header->width;
+        }
+
+        int getHeight() const {
+            return _header->height;
+        }
+
+        /**
+         * @return bytes needed to hold one decoded block
+         */
+        std::size_t getBlockBytes() const {
+            return (std::size_t) _header->rowsPerBlock * _header->width;
+        }
+
+        /**
+         * @param y row to get, 0 <= y < getHeight()
+         * @return getWidth() pixels, valid until the next call
+         */
+        const unsigned char *getRow(int y) {
+            int block = y / _header->rowsPerBlock;
+            std::size_t rowOffset = (std::size_t) (y % _header->rowsPerBlock) *
+                    _header->width;
+            const unsigned char *data = (const unsigned char *) _map +
+                    _offsets[block];
+            std::size_t len = _offsets[block + 1] - _offsets[block];
+            std::size_t rawBytes = blockBytes(block);
+            if (len == rawBytes) {
+                _bytesRead += _header->width;
+                return data + rowOffset;
+            }
+            if (block != _cachedBlock) {
+                _block.resize(rawBytes);
+                _cachedBlock = -1;
+                if (!lz4Decompress(data, len, &_block[0], rawBytes)) {
+                    fail("Corrupt block");
+                }
+                _cachedBlock = block;
+                _bytesRead += len;
+            }
+            return &_block[0] + rowOffset;
+        }
+
+        /**
+         * @return bytes of the header, block offsets, compressed blocks
+         *         decoded and rows of stored blocks read since open()
+         */
+        uint64_t getBytesRead() const {
+            return _bytesRead;
+        }
+
+    private:
+        RowBlockReader(const RowBlockReader& orig);
+        RowBlockReader& operator=(const RowBlockReader& orig);
+
+        /**
+         * @return decoded size of block b, the last one may be short
+         */
+        std::size_t blockBytes(uint32_t b) const {
+            int firstRow = b * _header->rowsPerBlock;
+            int rows = _header->height - firstRow;
+            if (rows > _header->rowsPerBlock) {
+                rows = _header->rowsPerBlock;
+            }
+            return (std::size_t) rows * _header->width;
+        }
+
+        void fail(const std::string& msg) {
+            throw itk::ExceptionObject(__FILE__, __LINE__, msg + ": " + _path,
+                    "spc::RowBlockReader");
+        }
+
+        std::string _path;
+        void *_map;
+        std::size_t _mapBytes;
+        const RowBlockHeader *_header;
+        const uint64_t *_offsets;
+        int _cachedBlock;
+        std::vector<unsigned char> _block;
+        uint64_t _bytesRead;
+    };
+
+    /**
+     * Decodes a row block image into an 8-bit greyscale image
+     * @param path .spr file
+     * @return decoded image
+     */
+    template < typename TImageType >
+    typename TImageType::Pointer readRowBlockImage(const std::string& path) {
+        RowBlockReader reader;
+        reader.open(path);
+
+        typename TImageType::SizeType imageSize;
+        imageSize[0] = reader.getWidth();
+        imageSize[1] = reader.getHeight();
+        typename TImageType::IndexType start;
+        start[0] = 0;
+        start[1] = 0;
+        typename TImageType::RegionType region;
+        region.SetSize(imageSize);
+        region.SetIndex(start);
+
+        typename TImageType::Pointer image = TImageType::New();
+        image->SetRegions(region);
+        image->Allocate();
+        unsigned char *buffer = (unsigned char *) image->GetBufferPointer();
+        for (int y = 0; y < reader.getHeight(); y++) {
+            memcpy(buffer + (std::size_t) y * reader.getWidth(),
+                    reader.getRow(y), reader.getWidth());
+        }
+        return image;
+    }
+}
+
+#endif	/* ROWBLOCKIMAGE_HPP */
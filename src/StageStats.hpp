@@ -0,0 +1,216 @@
+/*
+ * File:   StageStats.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef STAGESTATS_HPP
+#define	STAGESTATS_HPP
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "ImageProcessor.hpp"
+#include "OutputBuffer.hpp"
+
+namespace spc {
+
+    /**
+     * Distribution of the durations of one stage in microseconds.  Values
+     * below 16 are kept exactly, larger ones in 8 buckets per power of 2 so
+     * percentiles are within 12.5% whatever the number of values, and
+     * adding one is a few instructions.
+     */
+    class StageHistogram {
+    public:
+
+        StageHistogram() : _count(0), _total(0), _min(0), _max(0),
+        _buckets(16 + 60 * 8, 0) {
+        }
+
+        void add(long long micros) {
+            if (micros < 0) {
+                micros = 0;
+            }
+            if (_count == 0 || micros < _min) {
+                _min = micros;
+            }
+            if (micros > _max) {
+                _max = micros;
+            }
+            _count++;
+            _total += micros;
+            _buckets[getBucket(micros)]++;
+        }
+
+        long long getCount() const {
+            return _count;
+        }
+
+        long long getTotal() const {
+            return _total;
+        }
+
+        long long getMin() const {
+            return _min;
+        }
+
+        long long getMax() const {
+            return _max;
+        }
+
+        /**
+         * @param fraction 0 - 1, e.g. 0.9 for the 90th percentile
+         * @return middle of the bucket holding the percentile, limited to
+         *         the smallest and largest values added.  0 if there are no
+         *         values.
+         */
+        long long getPercentile(double fraction) const {
+            if (_count == 0) {
+                return 0;
+            }
+            long long rank = (long long) (fraction * _count + 0.5);
+            if (rank < 1) {
+                rank = 1;
+            }
+            long long seen = 0;
+            std::size_t bucket = 0;
+            for (; bucket + 1 < _buckets.size(); bucket++) {
+                seen += _buckets[bucket];
+                if (seen >= rank) {
+                    break;
+                }
+            }
+            long long value = getBucketMiddle(bucket);
+            return value < _min ? _min : (value > _max ? _max : value);
+        }
+
+    private:
+
+        static std::size_t getBucket(long long micros) {
+            if (micros < 16) {
+                return micros;
+            }
+            int exponent = 63 - __builtin_clzll(micros);
+            return 16 + (exponent - 4) * 8 + ((micros >> (exponent - 3)) & 7);
+        }
+
+        static long long getBucketMiddle(std::size_t bucket) {
+            if (bucket < 16) {
+                return bucket;
+            }
+            int exponent = (bucket - 16) / 8 + 4;
+            long long width = 1LL << (exponent - 3);
+            long long low = (1LL << exponent) + ((bucket - 16) % 8) * width;
+            return low + width / 2;
+        }
+
+        long long _count;
+        long long _total;
+        long long _min;
+        long long _max;
+        std::vector<long long> _buckets;
+    };
+
+    /**
+     * Per stage timings of a run for --timings.  Stages are:
+     *
+     *   enumerate  finding the images: the up front directory scan plus
+     *              stepping to each next image
+     *   read       reading tar members into memory.  Files are read by
+     *              their decoders, which counts as decode.
+     *   decode     reading and decoding images, for streamed images also
+     *              sampling them
+     *   sample     finding intersections above threshold
+     *   render     drawing masks and overlays
+     *   encode     compressing masks and overlays
+     *   write      writing masks and overlays to their files
+     *
+     * Each stage is recorded only for images that ran it.
+     */
+    class StageStats {
+    public:
+
+        enum Stage {
+            ENUMERATE, READ, DECODE, SAMPLE, RENDER, ENCODE, WRITE,
+            NUM_STAGES
+        };
+
+        StageStats() : _bytesRead(0), _bytesWritten(0) {
+        }
+
+        void add(Stage stage, long long micros) {
+            _stages[stage].add(micros);
+        }
+
+        /**
+         * Adds the stages of one processed image
+         */
+        void add(const ImageResult& result) {
+            if (result.stages & STAGE_DECODE) {
+                _stages[DECODE].add(result.decodeMicros);
+            }
+            if (result.stages & STAGE_SAMPLE) {
+                _stages[SAMPLE].add(result.sampleMicros);
+            }
+            if (result.stages & STAGE_RENDER) {
+                _stages[RENDER].add(result.renderMicros);
+            }
+            if (result.stages & STAGE_ENCODE) {
+                _stages[ENCODE].add(result.encodeMicros);
+            }
+            if (result.stages & STAGE_WRITE) {
+                _stages[WRITE].add(result.writeMicros);
+            }
+            _bytesRead += result.bytesRead;
+            _bytesWritten += result.bytesWritten;
+        }
+
+        /**
+         * Writes the timings as CSV, one row per stage followed by a block
+         * with the bytes read and written:
+         *
+         *     Stage,Count,TotalSeconds,MinMicros,MeanMicros,P50Micros,
+         *     P90Micros,P99Micros,MaxMicros
+         */
+        void writeCsv(OutputBuffer& out) const {
+            static const char *names[NUM_STAGES] = {
+                "enumerate", "read", "decode", "sample", "render", "encode",
+                "write"
+            };
+            LineBuilder line;
+            out.write("Stage,Count,TotalSeconds,MinMicros,MeanMicros,"
+                    "P50Micros,P90Micros,P99Micros,MaxMicros\n");
+            for (int i = 0; i < NUM_STAGES; i++) {
+                const StageHistogram &stage = _stages[i];
+                long long count = stage.getCount();
+                line.clear();
+                line.append(names[i]).append(',').append(count).append(',')
+                        .append(stage.getTotal() / 1e6).append(',')
+                        .append(stage.getMin()).append(',')
+                        .append(count > 0 ? stage.getTotal() / count : 0LL)
+                        .append(',').append(stage.getPercentile(0.5))
+                        .append(',').append(stage.getPercentile(0.9))
+                        .append(',').append(stage.getPercentile(0.99))
+                        .append(',').append(stage.getMax());
+                out.writeLine(line);
+            }
+            line.clear();
+            out.write("\nBytesRead,BytesWritten\n");
+            line.append((long long) _bytesRead).append(',')
+                    .append((long long) _bytesWritten);
+            out.writeLine(line);
+        }
+
+    private:
+        StageStats(const StageStats& orig);
+        StageStats& operator=(const StageStats& orig);
+
+        StageHistogram _stages[NUM_STAGES];
+        uint64_t _bytesRead;
+        uint64_t _bytesWritten;
+    };
+}
+
+#endif	/* STAGESTATS_HPP */
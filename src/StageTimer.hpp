@@ -0,0 +1,119 @@
+/*
+ * File:   StageTimer.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef STAGETIMER_HPP
+#define	STAGETIMER_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+
+namespace spc {
+
+    /**
+     * @return microseconds elapsed since start
+     */
+    inline long long microsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * Time spent in and bytes passed to countedWrite() and countedClose()
+     * by this process.  Mask and overlay writers go through these so the
+     * time writing files can be told apart from the time encoding them.
+     * Atomic as Deep Zoom tiles are written by several threads at once,
+     * whose write times then add up.
+     */
+    struct WriteCounters {
+        std::atomic<long long> nanos;
+        std::atomic<uint64_t> bytes;
+    };
+
+    inline WriteCounters& getWriteCounters() {
+        static WriteCounters counters;
+        return counters;
+    }
+
+    /**
+     * fwrite() that adds its time and bytes to getWriteCounters()
+     */
+    inline std::size_t countedWrite(const void *data, std::size_t size,
+            std::size_t count, FILE *fp) {
+        std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
+        std::size_t written = fwrite(data, size, count, fp);
+        WriteCounters &counters = getWriteCounters();
+        counters.nanos += std::chrono::duration_cast
+                <std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                start).count();
+        counters.bytes += (uint64_t) written * size;
+        return written;
+    }
+
+    /**
+     * fclose() that adds its time, which includes flushing what is left
+     * buffered, to getWriteCounters()
+     */
+    inline int countedClose(FILE *fp) {
+        std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
+        int rc = fclose(fp);
+        getWriteCounters().nanos += std::chrono::duration_cast
+                <std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                start).count();
+        return rc;
+    }
+
+    /**
+     * Splits the time of a loop that renders a row and then encodes it
+     * between the two stages.  Call rendered() after rendering each row
+     * and encoded() after encoding it, time before the first call counts
+     * as rendering.
+     */
+    class RowStageTimer {
+    public:
+
+        RowStageTimer() : _renderNanos(0), _encodeNanos(0),
+        _last(std::chrono::steady_clock::now()) {
+        }
+
+        void rendered() {
+            _renderNanos += lap();
+        }
+
+        void encoded() {
+            _encodeNanos += lap();
+        }
+
+        long long getRenderMicros() const {
+            return _renderNanos / 1000;
+        }
+
+        long long getEncodeMicros() const {
+            return _encodeNanos / 1000;
+        }
+
+    private:
+
+        long long lap() {
+            std::chrono::steady_clock::time_point now =
+                    std::chrono::steady_clock::now();
+            long long nanos = std::chrono::duration_cast
+                    <std::chrono::nanoseconds>(now - _last).count();
+            _last = now;
+            return nanos;
+        }
+
+        long long _renderNanos;
+        long long _encodeNanos;
+        std::chrono::steady_clock::time_point _last;
+    };
+}
+
+#endif	/* STAGETIMER_HPP */
@@ -0,0 +1,400 @@
+/*
+ * File:   StreamingSampler.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef STREAMINGSAMPLER_HPP
+#define	STREAMINGSAMPLER_HPP
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "itkImage.h"
+
+#include "IntersectionValues.hpp"
+#include "MappedImage.hpp"
+#include "PngReader.hpp"
+#include "RowBlockImage.hpp"
+#include "TiffReader.hpp"
+
+namespace spc {
+
+    /**
+     * Grid spacing used by getIntersectionPixelsAboveThreshold, grid lines
+     * are at multiples of the spacing greater than 0 and less than the
+     * image size
+     */
+    inline void getGridSpacing(int width, int height, int gridx, int gridy,
+            int &gridWidth, int &gridHeight) {
+        gridWidth = floor((float) width / (float) gridx);
+        gridHeight = floor((float) height / (float) gridy);
+    }
+
+    /**
+     * @return first grid line at or after pos
+     */
+    inline int firstGridLine(int pos, int spacing) {
+        if (pos <= spacing) {
+            return spacing;
+        }
+        return (pos + spacing - 1) / spacing * spacing;
+    }
+
+    /**
+     * Throws if bytes is more than maxMemory
+     * @param maxMemory limit in bytes, 0 means no limit
+     */
+    inline void checkMemory(std::size_t bytes, std::size_t maxMemory,
+            const std::string& what, const std::string& path) {
+        if (maxMemory > 0 && bytes > maxMemory) {
+            std::ostringstream os;
+            os << what << " needs " << (bytes >> 20) << " MB which is more "
+                    "than --maxmemory: " << path;
+            throw itk::ExceptionObject(__FILE__, __LINE__, os.str(),
+                    "spc::checkMemory");
+        }
+    }
+
+    /**
+     * Same as getIntersectionPixelsAboveThreshold but decodes a non
+     * interlaced PNG one row at a time, so only one row is ever in memory.
+     * Rows below the last grid row are not decoded at all.
+     * @param values if not NULL set to the value of every intersection
+     */
+    inline std::vector< std::pair<int, int> >
+    sampleIntersectionsFromPng(PngReader &reader, int gridx, int gridy,
+            int threshold, int &total_pixels, int &grid_width,
+            int &grid_height, IntersectionValues *values = NULL) {
+        std::vector< std::pair<int, int> > positivePixels;
+        int width = reader.getWidth();
+        int height = reader.getHeight();
+        getGridSpacing(width, height, gridx, gridy, grid_width, grid_height);
+        total_pixels = 0;
+        if (values != NULL) {
+            values->columns = gridLineCount(width, grid_width);
+            values->rows = gridLineCount(height, grid_height);
+            values->values.clear();
+            values->values.reserve((std::size_t) values->columns *
+                    values->rows);
+        }
+        if (grid_width <= 0 || grid_height <= 0) {
+            return positivePixels;
+        }
+        std::vector<unsigned char> row(width);
+        int nextGridRow = grid_height;
+        for (int y = 0; y < height && nextGridRow < height; y++) {
+            reader.readRow(&row[0]);
+            if (y != nextGridRow) {
+                continue;
+            }
+            for (int x = grid_width; x < width; x += grid_width) {
+                if (row[x] >= threshold) {
+                    positivePixels.push_back(std::make_pair(x, y));
+                }
+                total_pixels++;
+                if (values != NULL) {
+                    values->values.push_back(row[x]);
+                }
+            }
+            nextGridRow += grid_height;
+        }
+        // same order as getIntersectionPixelsAboveThreshold
+        std::sort(positivePixels.begin(), positivePixels.end());
+        return positivePixels;
+    }
+
+    /**
+     * Same as getIntersectionPixelsAboveThreshold but only decodes the TIFF
+     * tiles or strips that contain an intersection, one at a time.  Tiles
+     * without both a grid row and grid column are never read.
+     * @param maxMemory limit in bytes for one decoded tile or strip, 0
+     *        means no limit
+     * @param values if not NULL set to the value of every intersection
+     */
+    inline std::vector< std::pair<int, int> >
+    sampleIntersectionsFromTiff(TiffReader &reader, int gridx, int gridy,
+            int threshold, std::size_t maxMemory, const std::string& path,
+            int &total_pixels, int &grid_width, int &grid_height,
+            IntersectionValues *values = NULL) {
+        std::vector< std::pair<int, int> > positivePixels;
+        int width = reader.getWidth();
+        int height = reader.getHeight();
+        getGridSpacing(width, height, gridx, gridy, grid_width, grid_height);
+        total_pixels = 0;
+        if (values != NULL) {
+            values->columns = gridLineCount(width, grid_width);
+            values->rows = gridLineCount(height, grid_height);
+            values->values.assign((std::size_t) values->columns *
+                    values->rows, 0);
+        }
+        if (grid_width <= 0 || grid_height <= 0) {
+            return positivePixels;
+        }
+        checkMemory(reader.getBlockBytes(), maxMemory, "TIFF tile or strip",
+                path);
+        int blockWidth = reader.getBlockWidth();
+        int blockHeight = reader.getBlockHeight();
+        std::vector<unsigned char> block;
+        for (int by = 0; by < height; by += blockHeight) {
+            int blockBottom = std::min(by + blockHeight, height);
+            int firstY = firstGridLine(by, grid_height);
+            if (firstY >= blockBottom) {
+                continue;
+            }
+            for (int bx = 0; bx < width; bx += blockWidth) {
+                int blockRight = std::min(bx + blockWidth, width);
+                int firstX = firstGridLine(bx, grid_width);
+                if (firstX >= blockRight) {
+                    continue;
+                }
+                reader.readBlock(bx, by, block);
+                for (int y = firstY; y < blockBottom; y += grid_height) {
+                    for (int x = firstX; x < blockRight; x += grid_width) {
+                        unsigned char pixel = reader.getPixel(block, x - bx,
+                                y - by);
+                        if (pixel >= threshold) {
+                            positivePixels.push_back(std::make_pair(x, y));
+                        }
+                        total_pixels++;
+                        if (values != NULL) {
+                            values->values[(std::size_t) (y / grid_height - 1) *
+                                    values->columns + x / grid_width - 1] =
+                                    pixel;
+                        }
+                    }
+                }
+            }
+        }
+        std::sort(positivePixels.begin(), positivePixels.end());
+        return positivePixels;
+    }
+
+    /**
+     * Same as getIntersectionPixelsAboveThreshold but only reads the grid
+     * rows of an image, such as the row blocks of a .spr image or the
+     * mapped pages of a PGM, that hand out rows by number
+     * @param reader has getWidth(), getHeight() and getRow(y) returning a
+     *        pointer to the pixels of row y
+     * @param values if not NULL set to the value of every intersection
+     */
+    template < typename TRowReader >
+    std::vector< std::pair<int, int> >
+    sampleIntersectionsFromRows(TRowReader &reader, int gridx,
+            int gridy, int threshold, int &total_pixels, int &grid_width,
+            int &grid_height, IntersectionValues *values = NULL) {
+        std::vector< std::pair<int, int> > positivePixels;
+        int width = reader.getWidth();
+        int height = reader.getHeight();
+        getGridSpacing(width, height, gridx, gridy, grid_width, grid_height);
+        total_pixels = 0;
+        if (values != NULL) {
+            values->columns = gridLineCount(width, grid_width);
+            values->rows = gridLineCount(height, grid_height);
+            values->values.clear();
+            values->values.reserve((std::size_t) values->columns *
+                    values->rows);
+        }
+        if (grid_width <= 0 || grid_height <= 0) {
+            return positivePixels;
+        }
+        for (int y = grid_height; y < height; y += grid_height) {
+            const unsigned char *row = reader.getRow(y);
+            for (int x = grid_width; x < width; x += grid_width) {
+                if (row[x] >= threshold) {
+                    positivePixels.push_back(std::make_pair(x, y));
+                }
+                total_pixels++;
+                if (values != NULL) {
+                    values->values.push_back(row[x]);
+                }
+            }
+        }
+        std::sort(positivePixels.begin(), positivePixels.end());
+        return positivePixels;
+    }
+
+    /**
+     * Gets the first bytes of an image
+     * @param path image file
+     * @param data if not NULL contents of path, which is then not read
+     * @return number of bytes copied to signature
+     */
+    inline std::size_t readSignature(const std::string& path,
+            const std::vector<unsigned char> *data, unsigned char *signature,
+            std::size_t len) {
+        if (data != NULL) {
+            len = std::min(data->size(), len);
+            std::copy(data->begin(), data->begin() + len, signature);
+            return len;
+        }
+        FILE *fp = fopen(path.c_str(), "rb");
+        if (fp == NULL) {
+            return 0;
+        }
+        std::size_t numRead = fread(signature, 1, len, fp);
+        fclose(fp);
+        return numRead;
+    }
+
+    /**
+     * Size of a streamed image and how much of it was read
+     */
+    struct StreamedImageInfo {
+        int width;
+        int height;
+
+        /**
+         * Bytes of the file (or contents) read, see the readers'
+         * getBytesRead()
+         */
+        uint64_t bytesRead;
+    };
+
+    /**
+     * Fills info, if not NULL, from a reader that has been sampled
+     */
+    template < typename TReader >
+    void setStreamedImageInfo(const TReader &reader, StreamedImageInfo *info) {
+        if (info != NULL) {
+            info->width = reader.getWidth();
+            info->height = reader.getHeight();
+            info->bytesRead = reader.getBytesRead();
+        }
+    }
+
+    /**
+     * Samples the grid intersections of a PNG, TIFF, .spr, PGM or raw .u8
+     * image without ever holding the whole image in memory
+     * @param path image file
+     * @param data if not NULL contents of path, which is then not read
+     * @param maxMemory limit in bytes for decode buffers, 0 means no limit
+     * @param positivePixels set to intersections >= threshold
+     * @param values if not NULL set to the value of every intersection
+     * @param info if not NULL set to size of image and bytes read
+     * @return false if image is not in a format that can be streamed
+     *         (including interlaced or non greyscale PNG files and TIFF
+     *         layouts TiffReader does not decode), caller must then decode
+     *         it whole
+     */
+    inline bool sampleIntersectionsStreaming(const std::string& path,
+            const std::vector<unsigned char> *data, int gridx, int gridy,
+            int threshold, std::size_t maxMemory,
+            std::vector< std::pair<int, int> > &positivePixels,
+            int &total_pixels, int &grid_width, int &grid_height,
+            IntersectionValues *values = NULL,
+            StreamedImageInfo *info = NULL) {
+        unsigned char signature[8];
+        std::size_t len = readSignature(path, data, signature,
+                sizeof (signature));
+        if (isPngSignature(signature, len)) {
+            PngReader reader;
+            if (data != NULL) {
+                reader.open(&(*data)[0], data->size(), path);
+            } else {
+                reader.open(path);
+            }
+            // members of archives are decoded whole by PngReader too, files
+            // by ITK, which only agrees with PngReader on greyscale
+            if (reader.isInterlaced() ||
+                (data == NULL && !reader.isGreyscale())) {
+                return false;
+            }
+            checkMemory(reader.getWidth(), maxMemory, "PNG row", path);
+            positivePixels = sampleIntersectionsFromPng(reader, gridx, gridy,
+                    threshold, total_pixels, grid_width, grid_height, values);
+            setStreamedImageInfo(reader, info);
+            return true;
+        }
+        if (data == NULL && isTiffSignature(signature, len)) {
+            TiffReader reader;
+            reader.open(path);
+            if (!reader.isStreamable()) {
+                return false;
+            }
+            positivePixels = sampleIntersectionsFromTiff(reader, gridx, gridy,
+                    threshold, maxMemory, path, total_pixels, grid_width,
+                    grid_height, values);
+            setStreamedImageInfo(reader, info);
+            return true;
+        }
+        if (data == NULL && isRowBlockSignature(signature, len)) {
+            RowBlockReader reader;
+            reader.open(path);
+            checkMemory(reader.getBlockBytes(), maxMemory, "Row block", path);
+            positivePixels = sampleIntersectionsFromRows(reader, gridx,
+                    gridy, threshold, total_pixels, grid_width, grid_height,
+                    values);
+            setStreamedImageInfo(reader, info);
+            return true;
+        }
+        if (data == NULL && (isPgmSignature(signature, len) ||
+                isRawImagePath(path))) {
+            MappedImage mapped;
+            mapped.open(path);
+            positivePixels = sampleIntersectionsFromRows(mapped, gridx,
+                    gridy, threshold, total_pixels, grid_width, grid_height,
+                    values);
+            setStreamedImageInfo(mapped, info);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Gets size of a PNG, TIFF, .spr, PGM or raw .u8 image from its header
+     * @param path image file
+     * @param data if not NULL contents of path, which is then not read
+     * @return false if format is not PNG, TIFF, .spr, PGM or raw .u8
+     */
+    inline bool readImageSize(const std::string& path,
+            const std::vector<unsigned char> *data, int &width,
+            int &height) {
+        unsigned char signature[8];
+        std::size_t len = readSignature(path, data, signature,
+                sizeof (signature));
+        if (isPngSignature(signature, len)) {
+            PngReader reader;
+            if (data != NULL) {
+                reader.open(&(*data)[0], data->size(), path);
+            } else {
+                reader.open(path);
+            }
+            width = reader.getWidth();
+            height = reader.getHeight();
+            return true;
+        }
+        if (data == NULL && isTiffSignature(signature, len)) {
+            TiffReader reader;
+            reader.open(path);
+            width = reader.getWidth();
+            height = reader.getHeight();
+            return true;
+        }
+        if (data == NULL && isRowBlockSignature(signature, len)) {
+            RowBlockReader reader;
+            reader.open(path);
+            width = reader.getWidth();
+            height = reader.getHeight();
+            return true;
+        }
+        if (data == NULL && (isPgmSignature(signature, len) ||
+                isRawImagePath(path))) {
+            MappedImage mapped;
+            mapped.open(path);
+            width = mapped.getWidth();
+            height = mapped.getHeight();
+            return true;
+        }
+        return false;
+    }
+}
+
+#endif	/* STREAMINGSAMPLER_HPP */
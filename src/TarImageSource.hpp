@@ -0,0 +1,400 @@
+/*
+ * File:   TarImageSource.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef TARIMAGESOURCE_HPP
+#define	TARIMAGESOURCE_HPP
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "DirectoryScanner.hpp"
+#include "ImageSource.hpp"
+
+namespace spc {
+
+    /**
+     * Size of tar header and data blocks
+     */
+    const std::size_t TAR_BLOCK_SIZE = 512;
+
+    /**
+     * Largest GNU long name or pax extended header read into memory
+     */
+    const long long TAR_MAX_EXTRA_SIZE = 1 << 20;
+
+    /**
+     * Checks if path is a tar archive, either by name (*.tar) or by the
+     * ustar magic in its first header
+     * @param path
+     * @return true if yes, false otherwise
+     */
+    bool isTarArchive(const std::string& path) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            return false;
+        }
+        if (path.length() > 4 &&
+            path.compare(path.length() - 4, 4, ".tar") == 0) {
+            return true;
+        }
+        FILE *fp = fopen(path.c_str(), "rb");
+        if (fp == NULL) {
+            return false;
+        }
+        char header[TAR_BLOCK_SIZE];
+        bool isTar = fread(header, 1, sizeof (header), fp) == sizeof (header) &&
+                memcmp(header + 257, "ustar", 5) == 0;
+        fclose(fp);
+        return isTar;
+    }
+
+    /**
+     * ImageSource reading the members of an uncompressed tar archive in a
+     * single sequential pass.  Each member whose file name matches the
+     * patterns is loaded into memory and returned as archive:member, its
+     * contents are available from getData() until the next call to next().
+     * Nothing is extracted to disk.  A member larger than the memory
+     * limit, or one that cannot be allocated, is skipped without reading
+     * its data and returned with getMemberError() set, so it fails on its
+     * own instead of ending the run.
+     *
+     * Understands POSIX ustar headers (including the name prefix field),
+     * GNU long names ('L' entries), pax extended headers ('x' entries,
+     * path and size keys) and base-256 encoded sizes.
+     */
+    class TarImageSource : public ImageSource {
+    public:
+
+        /**
+         * @param archive tar file to read
+         * @param options patterns member file names must match
+         * @param maxMemory limit in bytes on the size of a member, 0 means
+         *        no limit
+         */
+        TarImageSource(const std::string& archive, const ScanOptions& options,
+                std::size_t maxMemory = 0) :
+        _archive(archive), _filter(options.patterns), _fp(NULL),
+        _maxMemory(maxMemory), _archiveBytes(-1) {
+            _fp = fopen(archive.c_str(), "rb");
+            if (_fp == NULL) {
+                _error = strerror(errno);
+                return;
+            }
+            setvbuf(_fp, NULL, _IOFBF, 1 << 20);
+            struct stat st;
+            if (fstat(fileno(_fp), &st) == 0 && S_ISREG(st.st_mode)) {
+                _archiveBytes = st.st_size;
+            }
+        }
+
+        virtual ~TarImageSource() {
+            if (_fp != NULL) {
+                fclose(_fp);
+            }
+        }
+
+        bool isOpen() const {
+            return _fp != NULL;
+        }
+
+        /**
+         * @return reason reading stopped early, empty if the archive was
+         *         read to the end
+         */
+        const std::string& getError() const {
+            return _error;
+        }
+
+        /**
+         * @return reason the data of the member last returned by next()
+         *         was skipped, empty if it was read
+         */
+        const std::string& getMemberError() const {
+            return _memberError;
+        }
+
+        virtual bool next(std::string& path) {
+            return nextMember(path, true);
+        }
+
+        /**
+         * Steps over the next matching member without reading its data
+         */
+        virtual bool skipNext(std::string& path) {
+            return nextMember(path, false);
+        }
+
+        virtual const std::vector<unsigned char> *getData() const {
+            return &_data;
+        }
+
+    private:
+        TarImageSource(const TarImageSource& orig);
+        TarImageSource& operator=(const TarImageSource& orig);
+
+        /**
+         * @param wantData false to skip the member's data instead of
+         *        reading it
+         */
+        bool nextMember(std::string& path, bool wantData) {
+            if (_fp == NULL) {
+                return false;
+            }
+            std::string longName;
+            long long paxSize = -1;
+            unsigned char header[TAR_BLOCK_SIZE];
+            while (true) {
+                std::size_t numRead = fread(header, 1, sizeof (header), _fp);
+                if (numRead == 0 && feof(_fp) && longName.empty()) {
+                    // archive without end of archive marker
+                    return false;
+                }
+                if (numRead != sizeof (header)) {
+                    _error = ferror(_fp) ? strerror(errno) :
+                            "unexpected end of tar archive";
+                    return false;
+                }
+                if (isZeroBlock(header)) {
+                    // end of archive marker
+                    return false;
+                }
+                if (!checksumOk(header)) {
+                    _error = "bad tar header checksum";
+                    return false;
+                }
+                long long size = paxSize >= 0 ? paxSize :
+                        parseNumber(header + 124, 12);
+                if (size < 0) {
+                    _error = "bad tar header size";
+                    return false;
+                }
+                if (_archiveBytes >= 0 && size > _archiveBytes - ftello(_fp)) {
+                    // corrupt size field or archive cut short, either way
+                    // nothing after this header can be read
+                    _error = "unexpected end of tar archive";
+                    return false;
+                }
+                char type = header[156];
+                if (type == 'L' || type == 'x') {
+                    if (size > TAR_MAX_EXTRA_SIZE) {
+                        _error = "tar extended header too large";
+                        return false;
+                    }
+                    std::vector<unsigned char> extra;
+                    if (!readData(size, extra)) {
+                        return false;
+                    }
+                    if (type == 'L') {
+                        longName.assign(extra.begin(), extra.end());
+                        longName = longName.c_str();
+                    } else {
+                        parsePax(extra, longName, paxSize);
+                    }
+                    continue;
+                }
+                std::string name = longName.empty() ? headerName(header) :
+                        longName;
+                longName.clear();
+                paxSize = -1;
+
+                bool regular = type == '0' || type == '\0' || type == '7';
+                std::size_t slash = name.find_last_of('/');
+                const char *fileName = name.c_str() +
+                        (slash == std::string::npos ? 0 : slash + 1);
+                if (!regular || !_filter.matches(fileName, strlen(fileName))) {
+                    if (!skipData(paddedSize(size))) {
+                        return false;
+                    }
+                    continue;
+                }
+                path = _archive + ":" + name;
+                _memberError.clear();
+                if (!wantData) {
+                    _data.clear();
+                    return skipData(paddedSize(size));
+                }
+                if (_maxMemory > 0 && (unsigned long long) size > _maxMemory) {
+                    std::ostringstream os;
+                    os << "Member of " << size << " bytes is larger than "
+                            "--maxmemory";
+                    _memberError = os.str();
+                }
+                else {
+                    try {
+                        _data.resize(size);
+                    } catch (std::bad_alloc& e) {
+                        std::ostringstream os;
+                        os << "Unable to allocate " << size
+                                << " bytes for member";
+                        _memberError = os.str();
+                    }
+                }
+                if (!_memberError.empty()) {
+                    _data.clear();
+                    return skipData(paddedSize(size));
+                }
+                return readData(size, _data);
+            }
+        }
+
+        static bool isZeroBlock(const unsigned char *header) {
+            for (std::size_t i = 0; i < TAR_BLOCK_SIZE; i++) {
+                if (header[i] != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static bool checksumOk(const unsigned char *header) {
+            long long stored = parseNumber(header + 148, 8);
+            long sum = 0;
+            for (std::size_t i = 0; i < TAR_BLOCK_SIZE; i++) {
+                // checksum field itself counts as spaces
+                sum += (i >= 148 && i < 156) ? ' ' : header[i];
+            }
+            return stored == sum;
+        }
+
+        /**
+         * Parses octal numeric field, or base-256 if high bit of first byte
+         * is set (GNU extension for sizes of 8 GB and up)
+         * @return value or -1 if field is malformed
+         */
+        static long long parseNumber(const unsigned char *field,
+                std::size_t len) {
+            long long value = 0;
+            if (field[0] & 0x80) {
+                for (std::size_t i = 1; i < len; i++) {
+                    if (value >> 55) {
+                        return -1;
+                    }
+                    value = (value << 8) | field[i];
+                }
+                return value;
+            }
+            std::size_t i = 0;
+            while (i < len && field[i] == ' ') {
+                i++;
+            }
+            for (; i < len && field[i] >= '0' && field[i] <= '7'; i++) {
+                value = (value << 3) | (field[i] - '0');
+            }
+            if (i < len && field[i] != ' ' && field[i] != '\0') {
+                return -1;
+            }
+            return value;
+        }
+
+        static std::string headerName(const unsigned char *header) {
+            std::string name((const char *) header,
+                    strnlen((const char *) header, 100));
+            if (memcmp(header + 257, "ustar\0", 6) == 0 && header[345] != 0) {
+                std::string prefix((const char *) header + 345,
+                        strnlen((const char *) header + 345, 155));
+                name = prefix + "/" + name;
+            }
+            return name;
+        }
+
+        /**
+         * Parses pax extended header records of the form
+         * "<len> <key>=<value>\n"
+         */
+        static void parsePax(const std::vector<unsigned char> &extra,
+                std::string& name, long long &size) {
+            std::string records(extra.begin(), extra.end());
+            std::size_t pos = 0;
+            while (pos < records.size()) {
+                char *end;
+                long len = strtol(records.c_str() + pos, &end, 10);
+                std::size_t keyStart = end - records.c_str() + 1;
+                if (len <= 0 || pos + len > records.size() ||
+                    keyStart >= pos + len) {
+                    return;
+                }
+                std::string record = records.substr(keyStart,
+                        pos + len - 1 - keyStart);
+                std::size_t eq = record.find('=');
+                if (eq != std::string::npos) {
+                    std::string key = record.substr(0, eq);
+                    if (key == "path") {
+                        name = record.substr(eq + 1);
+                    } else if (key == "size") {
+                        size = strtoll(record.c_str() + eq + 1, NULL, 10);
+                    }
+                }
+                pos += len;
+            }
+        }
+
+        bool readFully(void *buffer, std::size_t len) {
+            if (fread(buffer, 1, len, _fp) != len) {
+                if (ferror(_fp)) {
+                    _error = strerror(errno);
+                } else {
+                    _error = "unexpected end of tar archive";
+                }
+                return false;
+            }
+            return true;
+        }
+
+        static long long paddedSize(long long size) {
+            return (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE *
+                    TAR_BLOCK_SIZE;
+        }
+
+        bool readData(long long size, std::vector<unsigned char> &data) {
+            data.resize(size);
+            if (size > 0 && !readFully(&data[0], size)) {
+                return false;
+            }
+            return skipData(paddedSize(size) - size);
+        }
+
+        /**
+         * Skips bytes, seeking when the archive is seekable and the skip is
+         * large, reading otherwise
+         */
+        bool skipData(long long size) {
+            if (size > (long long) (1 << 20) &&
+                fseeko(_fp, size, SEEK_CUR) == 0) {
+                return true;
+            }
+            char buffer[TAR_BLOCK_SIZE];
+            while (size > 0) {
+                std::size_t len = size < (long long) sizeof (buffer) ?
+                        (std::size_t) size : sizeof (buffer);
+                if (!readFully(buffer, len)) {
+                    return false;
+                }
+                size -= len;
+            }
+            return true;
+        }
+
+        std::string _archive;
+        FileNameFilter _filter;
+        FILE *_fp;
+        std::string _error;
+        std::string _memberError;
+        std::vector<unsigned char> _data;
+        std::size_t _maxMemory;
+        long long _archiveBytes;
+    };
+}
+
+#endif	/* TARIMAGESOURCE_HPP */
@@ -0,0 +1,276 @@
+/*
+ * File:   TiffReader.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef TIFFREADER_HPP
+#define	TIFFREADER_HPP
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "itkImage.h"
+#include "itk_tiff.h"
+
+namespace spc {
+
+    /**
+     * Holds the last libtiff error message, libtiff reports errors through
+     * a global handler rather than return values
+     */
+    inline char *tiffErrorBuffer() {
+        static char buffer[512] = "";
+        return buffer;
+    }
+
+    extern "C" inline void spcTiffErrorHandler(const char *module,
+            const char *fmt, va_list ap) {
+        vsnprintf(tiffErrorBuffer(), 512, fmt, ap);
+    }
+
+    /**
+     * @return true if data starts with a TIFF or BigTIFF signature
+     */
+    inline bool isTiffSignature(const unsigned char *data, std::size_t size) {
+        if (size < 4) {
+            return false;
+        }
+        return (data[0] == 'I' && data[1] == 'I' &&
+                (data[2] == 42 || data[2] == 43) && data[3] == 0) ||
+                (data[0] == 'M' && data[1] == 'M' && data[2] == 0 &&
+                (data[3] == 42 || data[3] == 43));
+    }
+
+    /**
+     * Block oriented TIFF/BigTIFF decoder.  Pixels are read one tile, or
+     * for stripped files one strip, at a time and only converted to 8-bit
+     * greyscale when asked for, so a mosaic far larger than memory can be
+     * sampled.  Decodes 8-bit unsigned greyscale and RGB images with any
+     * compression libtiff decodes, the layouts whose pixels come out as
+     * ITK's readImage() would give them.  Other layouts open with only
+     * their size read and isStreamable() false, they must be decoded
+     * with readImage().
+     */
+    class TiffReader {
+    public:
+
+        TiffReader() : _tiff(NULL), _width(0), _height(0), _tiled(false),
+        _blockWidth(0), _blockHeight(0), _blockBytes(0), _samplesPerPixel(1),
+        _photometric(PHOTOMETRIC_MINISBLACK), _streamable(false),
+        _byteCounts(NULL), _bytesRead(0) {
+        }
+
+        virtual ~TiffReader() {
+            close();
+        }
+
+        /**
+         * Opens path and reads the TIFF directory of the first image
+         * @param path input file
+         */
+        void open(const std::string& path) {
+            close();
+            _name = path;
+            TIFFSetErrorHandler(spcTiffErrorHandler);
+            TIFFSetWarningHandler(NULL);
+            tiffErrorBuffer()[0] = '\0';
+            _tiff = TIFFOpen(path.c_str(), "r");
+            if (_tiff == NULL) {
+                fail("Unable to open TIFF");
+            }
+            uint32_t width = 0;
+            uint32_t height = 0;
+            uint16_t samplesPerPixel = 1;
+            uint16_t bitsPerSample = 8;
+            uint16_t planarConfig = PLANARCONFIG_CONTIG;
+            uint16_t sampleFormat = SAMPLEFORMAT_UINT;
+            uint16_t photometric = PHOTOMETRIC_MINISBLACK;
+            TIFFGetField(_tiff, TIFFTAG_IMAGEWIDTH, &width);
+            TIFFGetField(_tiff, TIFFTAG_IMAGELENGTH, &height);
+            TIFFGetFieldDefaulted(_tiff, TIFFTAG_SAMPLESPERPIXEL,
+                    &samplesPerPixel);
+            TIFFGetFieldDefaulted(_tiff, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+            TIFFGetFieldDefaulted(_tiff, TIFFTAG_PLANARCONFIG, &planarConfig);
+            TIFFGetFieldDefaulted(_tiff, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+            TIFFGetField(_tiff, TIFFTAG_PHOTOMETRIC, &photometric);
+
+            _width = width;
+            _height = height;
+            _samplesPerPixel = samplesPerPixel;
+            _photometric = photometric;
+            _byteCounts = NULL;
+            _bytesRead = 0;
+            // ITK scales 16-bit samples, inverts min-is-white and weights
+            // by alpha differently, leave those to it
+            _streamable = bitsPerSample == 8 &&
+                    sampleFormat == SAMPLEFORMAT_UINT &&
+                    ((photometric == PHOTOMETRIC_MINISBLACK &&
+                    samplesPerPixel == 1) ||
+                    (photometric == PHOTOMETRIC_RGB && samplesPerPixel == 3 &&
+                    planarConfig == PLANARCONFIG_CONTIG));
+            if (!_streamable) {
+                return;
+            }
+            _tiled = TIFFIsTiled(_tiff);
+            if (_tiled) {
+                uint32_t tileWidth = 0;
+                uint32_t tileHeight = 0;
+                TIFFGetField(_tiff, TIFFTAG_TILEWIDTH, &tileWidth);
+                TIFFGetField(_tiff, TIFFTAG_TILELENGTH, &tileHeight);
+                _blockWidth = tileWidth;
+                _blockHeight = tileHeight;
+                _blockBytes = TIFFTileSize(_tiff);
+            } else {
+                uint32_t rowsPerStrip = height;
+                TIFFGetFieldDefaulted(_tiff, TIFFTAG_ROWSPERSTRIP,
+                        &rowsPerStrip);
+                _blockWidth = width;
+                _blockHeight = rowsPerStrip < height ? rowsPerStrip : height;
+                _blockBytes = TIFFStripSize(_tiff);
+            }
+            if (_blockWidth <= 0 || _blockHeight <= 0 || _blockBytes == 0) {
+                fail("Invalid TIFF tile or strip size");
+            }
+            TIFFGetField(_tiff, _tiled ? TIFFTAG_TILEBYTECOUNTS :
+                    TIFFTAG_STRIPBYTECOUNTS, &_byteCounts);
+        }
+
+        int getWidth() const {
+            return _width;
+        }
+
+        int getHeight() const {
+            return _height;
+        }
+
+        /**
+         * @return false if the layout cannot be decoded by this reader, only
+         *         the size is then available
+         */
+        bool isStreamable() const {
+            return _streamable;
+        }
+
+        bool isTiled() const {
+            return _tiled;
+        }
+
+        /**
+         * Width of a tile, or of the image for stripped files
+         */
+        int getBlockWidth() const {
+            return _blockWidth;
+        }
+
+        /**
+         * Height of a tile or strip
+         */
+        int getBlockHeight() const {
+            return _blockHeight;
+        }
+
+        /**
+         * Bytes needed to hold one decoded tile or strip
+         */
+        std::size_t getBlockBytes() const {
+            return _blockBytes;
+        }
+
+        /**
+         * Decodes the tile or strip containing pixel x, y
+         * @param x
+         * @param y
+         * @param block resized to getBlockBytes() and set to decoded pixels
+         */
+        void readBlock(int x, int y, std::vector<unsigned char> &block) {
+            block.resize(_blockBytes);
+            tmsize_t numRead;
+            uint32_t index;
+            if (_tiled) {
+                index = TIFFComputeTile(_tiff, x, y, 0, 0);
+                numRead = TIFFReadEncodedTile(_tiff, index, &block[0],
+                        _blockBytes);
+            } else {
+                index = TIFFComputeStrip(_tiff, y, 0);
+                numRead = TIFFReadEncodedStrip(_tiff, index, &block[0],
+                        _blockBytes);
+            }
+            if (numRead < 0) {
+                fail("Error decoding TIFF block");
+            }
+            if (_byteCounts != NULL) {
+                _bytesRead += _byteCounts[index];
+            }
+        }
+
+        /**
+         * @return stored (compressed) bytes of the tiles or strips read
+         *         since open()
+         */
+        uint64_t getBytesRead() const {
+            return _bytesRead;
+        }
+
+        /**
+         * Converts one pixel of a decoded block to 8-bit greyscale, RGB uses
+         * the same luminance weights and truncation as
+         * itk::ConvertPixelBuffer
+         * @param block from readBlock()
+         * @param x column within block
+         * @param y row within block
+         */
+        unsigned char getPixel(const std::vector<unsigned char> &block,
+                int x, int y) const {
+            std::size_t index = ((std::size_t) y * _blockWidth + x) *
+                    _samplesPerPixel;
+            const unsigned char *p = &block[index];
+            if (_photometric == PHOTOMETRIC_RGB) {
+                return (unsigned char) ((2125 * p[0] + 7154 * p[1] +
+                        721 * p[2]) / 10000);
+            }
+            return p[0];
+        }
+
+        void close() {
+            if (_tiff != NULL) {
+                TIFFClose(_tiff);
+            }
+            _tiff = NULL;
+        }
+
+    private:
+        TiffReader(const TiffReader& orig);
+        TiffReader& operator=(const TiffReader& orig);
+
+        void fail(const std::string& msg) {
+            close();
+            std::string detail = tiffErrorBuffer();
+            throw itk::ExceptionObject(__FILE__, __LINE__,
+                    msg + ": " + _name + (detail.empty() ? "" : ": " + detail),
+                    "spc::TiffReader");
+        }
+
+        TIFF *_tiff;
+        int _width;
+        int _height;
+        bool _tiled;
+        int _blockWidth;
+        int _blockHeight;
+        std::size_t _blockBytes;
+        int _samplesPerPixel;
+        int _photometric;
+        bool _streamable;
+
+        // stored size of each tile or strip, owned by libtiff
+        uint64_t *_byteCounts;
+        uint64_t _bytesRead;
+        std::string _name;
+    };
+}
+
+#endif	/* TIFFREADER_HPP */
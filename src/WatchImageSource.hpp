@@ -0,0 +1,229 @@
+/*
+ * File:   WatchImageSource.hpp
+ *
+ * Created on October 18, 2026
+ */
+
+#ifndef WATCHIMAGESOURCE_HPP
+#define	WATCHIMAGESOURCE_HPP
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "DirectoryScanner.hpp"
+#include "ImageSource.hpp"
+
+namespace spc {
+
+    /**
+     * ImageSource that first returns the images already in a directory and
+     * then blocks waiting for new ones, returning each as soon as it is
+     * complete.  Files count as complete when they are closed after
+     * writing or renamed into the directory, a file rewritten or renamed
+     * into place again later is returned again.  Only what is queued
+     * while watching starts is kept to drop duplicates, so memory does not
+     * grow with the number of files seen.  Watching ends once every
+     * watched directory is gone.  Uses inotify so this is only available
+     * on Linux.
+     */
+    class WatchImageSource : public ImageSource {
+    public:
+
+        /**
+         * @param directory directory to watch
+         * @param options patterns files must match, if recursive is set
+         *        subdirectories, including ones created later, are watched
+         *        too
+         * @param stop next() returns false once this is nonzero, intended
+         *        to be set from a SIGINT or SIGTERM handler
+         */
+        WatchImageSource(const std::string& directory,
+                const ScanOptions& options, volatile sig_atomic_t *stop) :
+        _options(options), _filter(options.patterns), _stop(stop), _fd(-1) {
+#ifdef __linux__
+            _fd = inotify_init1(IN_CLOEXEC);
+            if (_fd >= 0) {
+                addDirectory(directory);
+                drainBacklog();
+            }
+#endif
+        }
+
+        virtual ~WatchImageSource() {
+            if (_fd >= 0) {
+                close(_fd);
+            }
+        }
+
+        /**
+         * @return false if watching could not be set up
+         */
+        bool isOpen() const {
+            return _fd >= 0 && !_watches.empty();
+        }
+
+        virtual bool next(std::string& path) {
+#ifdef __linux__
+            while (!*_stop) {
+                if (!_ready.empty()) {
+                    path = _ready.front();
+                    _ready.pop_front();
+                    return true;
+                }
+                if (_watches.empty() || !readEvents(true)) {
+                    return false;
+                }
+                if (!_listed.empty()) {
+                    drainBacklog();
+                }
+            }
+#endif
+            return false;
+        }
+
+    private:
+        WatchImageSource(const WatchImageSource& orig);
+        WatchImageSource& operator=(const WatchImageSource& orig);
+
+#ifdef __linux__
+
+        /**
+         * Starts watching directory and queues images already in it.  The
+         * watch is added before listing so nothing written in between is
+         * missed, the events that also cover listed files are dropped by
+         * drainBacklog().
+         */
+        void addDirectory(const std::string& directory) {
+            uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE_SELF;
+            if (_options.recursive) {
+                mask |= IN_CREATE;
+            }
+            int wd = inotify_add_watch(_fd, directory.c_str(), mask);
+            if (wd < 0) {
+                return;
+            }
+            _watches[wd] = directory;
+
+            std::vector<std::string> files;
+            std::vector<std::string> subdirs;
+            scanOneDirectory(directory, _filter, files,
+                    _options.recursive ? &subdirs : NULL);
+            std::sort(files.begin(), files.end());
+            _ready.insert(_ready.end(), files.begin(), files.end());
+            _listed.insert(files.begin(), files.end());
+            std::sort(subdirs.begin(), subdirs.end());
+            for (std::size_t i = 0; i < subdirs.size(); i++) {
+                addDirectory(subdirs[i]);
+            }
+        }
+
+        /**
+         * Reads the events queued before the latest directory listing
+         * finished, dropping those for files the listing already queued,
+         * then forgets the listed files so later events for them queue
+         * them again
+         */
+        void drainBacklog() {
+            while (readEvents(false)) {
+            }
+            _listed.clear();
+        }
+
+        /**
+         * Queues a completed image unless a listing still being drained
+         * already queued it
+         */
+        void queue(const std::string& path) {
+            if (_listed.find(path) == _listed.end()) {
+                _ready.push_back(path);
+            }
+        }
+
+        /**
+         * Reads inotify events and queues any completed images
+         * @param wait if true blocks until at least one event arrives or
+         *        stop is set, otherwise only reads events already queued
+         * @return false on error, once stop is set or, if wait is false,
+         *         when no events were queued
+         */
+        bool readEvents(bool wait) {
+            if (wait) {
+                if (!waitForInput(_fd, _stop)) {
+                    return false;
+                }
+            } else {
+                struct pollfd pfd;
+                pfd.fd = _fd;
+                pfd.events = POLLIN;
+                if (poll(&pfd, 1, 0) <= 0) {
+                    return false;
+                }
+            }
+            char buffer[64 * 1024]
+                    __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t numRead = read(_fd, buffer, sizeof (buffer));
+            if (numRead <= 0) {
+                return numRead < 0 && errno == EINTR;
+            }
+            for (char *ptr = buffer; ptr < buffer + numRead;) {
+                struct inotify_event *event = (struct inotify_event *) ptr;
+                ptr += sizeof (struct inotify_event) + event->len;
+
+                std::map<int, std::string>::iterator itr =
+                        _watches.find(event->wd);
+                if (event->mask & (IN_IGNORED | IN_DELETE_SELF)) {
+                    if (itr != _watches.end()) {
+                        _watches.erase(itr);
+                    }
+                    continue;
+                }
+                if (itr == _watches.end() || event->len == 0) {
+                    continue;
+                }
+                std::string path = itr->second + "/" + event->name;
+                if (event->mask & IN_ISDIR) {
+                    if (_options.recursive &&
+                        (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                        addDirectory(path);
+                    }
+                    continue;
+                }
+                if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) &&
+                    _filter.matches(event->name, strlen(event->name))) {
+                    queue(path);
+                }
+            }
+            return true;
+        }
+#endif
+
+        ScanOptions _options;
+        FileNameFilter _filter;
+        volatile sig_atomic_t *_stop;
+        int _fd;
+        std::map<int, std::string> _watches;
+        std::deque<std::string> _ready;
+
+        /**
+         * Files queued by directory listings whose backlog of events is
+         * not yet drained
+         */
+        std::set<std::string> _listed;
+    };
+}
+
+#endif	/* WATCHIMAGESOURCE_HPP */
@@ -0,0 +1,484 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+
+#include "optionparser.h"
+#include "OptionArg.hpp"
+#include "ImageUtils.hpp"
+
+/**
+ * Microbenchmarks of the ImageUtils kernels over a sweep of image sizes,
+ * grid densities and hit ratios.  Results are CSV on standard out, one row
+ * per kernel and case, so runs of different commits can be joined on the
+ * Kernel, Width, Height, Grid and HitRatio columns and compared.
+ */
+
+std::string usageStr = "usage: stereopointcounter_bench [options]\n\n"
+        "Times the ImageUtils kernels getIntersectionPixelsAboveThreshold, "
+        "drawGridOnImage, drawCircle, drawCirclesAroundPointsOnImage, "
+        "castImageToRGBImage, duplicateImage, readImage, writeImage, "
+        "countAtOrAboveThreshold, thresholdAndPackRow (over every row), "
+        "popcountBytes (over the packed image) and popcountAnd (over the "
+        "grid rows of the packed image) on synthetic 8-bit greyscale images "
+        "of uniformly random pixels.\n\n"
+        "Every kernel runs for every --sizes (square images), kernels "
+        "depending on the grid also for every --grids (grid lines each "
+        "way) and kernels depending on the threshold also for every --hits "
+        "(fraction of intersections or pixels at or above threshold). Each "
+        "case is repeated until --mintime has passed.\n\n"
+        "Output is to standard out and format is comma separated variables "
+        "in the following format, fields a kernel does not depend on are "
+        "left empty:\n\n"
+        "\tKernel,Width,Height,Grid,HitRatio,Iterations,MinMicros,"
+        "MedianMicros,MeanMicros\n"
+        "\tdrawGridOnImage,2048,2048,20,,307,636.884,651.506,690.486\n\n";
+
+std::string usageWithOpts = usageStr + "Options:";
+
+/**
+ * Used by optionparser to keep track of command line arguments
+ */
+enum optionIndex {
+    UNKNOWN, HELP, SIZES, GRIDS, HITS, MINTIME, TMPDIR
+};
+
+/**
+ * Defines command line options
+ */
+const option::Descriptor usage[] = {
+    {UNKNOWN, 0, "", "", option::Arg::None, usageWithOpts.c_str()},
+    {HELP, 0, "", "help", option::Arg::None, "  --help  \tPrint usage and exit."},
+    {SIZES, 0, "", "sizes", spc::Arg::Required,
+        "  --sizes,  \tComma separated widths of the square images. "
+        "Default is 512,2048,8192"},
+    {GRIDS, 0, "", "grids", spc::Arg::Required,
+        "  --grids,  \tComma separated numbers of grid lines in each "
+        "direction. Default is 5,20,100"},
+    {HITS, 0, "", "hits", spc::Arg::Required,
+        "  --hits,  \tComma separated fractions of intersections or "
+        "pixels at or above threshold, 0 - 1. Default is 0,0.5,1"},
+    {MINTIME, 0, "", "mintime", spc::Arg::Required,
+        "  --mintime,  \tSeconds to repeat each case for, at least 3 "
+        "repetitions are always run. Default is 0.2"},
+    {TMPDIR, 0, "", "tmpdir", spc::Arg::RequiredDir,
+        "  --tmpdir,  \tDirectory for the files of readImage and "
+        "writeImage. Default is /tmp"},
+    {0, 0, 0, 0, 0, 0}
+};
+
+typedef unsigned char PixelType;
+typedef itk::Image<PixelType, spc::DIMENSION> ImageType;
+
+/**
+ * Radius of the circles marking positive intersections in overlays
+ */
+const double CIRCLE_RADIUS = 5.0;
+
+/**
+ * Parses a comma separated list of numbers
+ * @return false if list is empty or holds anything but numbers
+ */
+bool parseList(const char *arg, std::vector<double> &values) {
+    values.clear();
+    std::istringstream in(arg);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        char *end = NULL;
+        double value = strtod(item.c_str(), &end);
+        if (item.empty() || *end != '\0') {
+            return false;
+        }
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+/**
+ * Square image of uniformly random pixels, so a threshold picks any
+ * fraction of intersections
+ */
+ImageType::Pointer createImage(int width) {
+    ImageType::SizeType size;
+    size[0] = width;
+    size[1] = width;
+    ImageType::IndexType start;
+    start[0] = 0;
+    start[1] = 0;
+    ImageType::RegionType region;
+    region.SetSize(size);
+    region.SetIndex(start);
+    ImageType::Pointer image = ImageType::New();
+    image->SetRegions(region);
+    image->Allocate();
+
+    PixelType *buffer = image->GetBufferPointer();
+    std::size_t numPixels = (std::size_t) width * width;
+    uint32_t state = 2463534242u;
+    for (std::size_t i = 0; i < numPixels; i++) {
+        // xorshift32, the same pixels every run
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        buffer[i] = state >> 24;
+    }
+    return image;
+}
+
+/**
+ * @return threshold that about hitRatio of uniformly random pixels are at
+ *         or above
+ */
+int getThreshold(double hitRatio) {
+    int threshold = (int) (256.0 * (1.0 - hitRatio) + 0.5);
+    return std::max(0, std::min(256, threshold));
+}
+
+/**
+ * Collects the time of each repetition of one case and writes its result
+ * row
+ */
+class CaseTimer {
+public:
+
+    CaseTimer(double minSeconds) : _minMicros(minSeconds * 1e6),
+    _elapsedMicros(0) {
+    }
+
+    /**
+     * @return true while more repetitions are needed, call before each
+     */
+    bool more() {
+        return _micros.size() < 3 || _elapsedMicros < _minMicros;
+    }
+
+    void start() {
+        _start = std::chrono::steady_clock::now();
+    }
+
+    void stop() {
+        double micros = std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - _start).count();
+        _micros.push_back(micros);
+        _elapsedMicros += micros;
+    }
+
+    /**
+     * Writes the result row, grid and hitRatio are left empty if < 0
+     */
+    void write(const std::string& kernel, int width, int grid,
+            double hitRatio) {
+        std::sort(_micros.begin(), _micros.end());
+        std::cout << kernel << "," << width << "," << width << ",";
+        if (grid >= 0) {
+            std::cout << grid;
+        }
+        std::cout << ",";
+        if (hitRatio >= 0) {
+            std::cout << hitRatio;
+        }
+        std::cout << "," << _micros.size() << "," << _micros[0] << ","
+                << _micros[_micros.size() / 2] << ","
+                << _elapsedMicros / _micros.size() << std::endl;
+    }
+
+private:
+    std::chrono::steady_clock::time_point _start;
+    double _minMicros;
+    double _elapsedMicros;
+    std::vector<double> _micros;
+};
+
+/**
+ * Intersections of image at threshold, less those closer to the edge than
+ * the circle radius as drawCircle() does not clip
+ */
+std::vector< std::pair<int, int> > getCirclePoints(ImageType::Pointer const &image,
+        int grid, int threshold) {
+    int total;
+    int gridWidth;
+    int gridHeight;
+    std::vector< std::pair<int, int> > points =
+            spc::getIntersectionPixelsAboveThreshold<PixelType>(image, grid,
+            grid, threshold, total, gridWidth, gridHeight);
+    ImageType::SizeType size = image->GetLargestPossibleRegion().GetSize();
+    int margin = (int) CIRCLE_RADIUS + 1;
+    std::vector< std::pair<int, int> > inside;
+    for (std::size_t i = 0; i < points.size(); i++) {
+        if (points[i].first >= margin && points[i].second >= margin &&
+            points[i].first < (int) size[0] - margin &&
+            points[i].second < (int) size[1] - margin) {
+            inside.push_back(points[i]);
+        }
+    }
+    return inside;
+}
+
+/**
+ * Results of kernels that return a count are added here so the compiler
+ * cannot drop the calls
+ */
+volatile std::size_t countSink = 0;
+
+/**
+ * Thresholds every row of image into packed, 8 pixels per byte
+ */
+void packImage(ImageType::Pointer const &image, int threshold,
+        std::vector<unsigned char> &packed) {
+    int width = image->GetLargestPossibleRegion().GetSize()[0];
+    int height = image->GetLargestPossibleRegion().GetSize()[1];
+    std::size_t rowBytes = (width + 7) / 8;
+    packed.resize(rowBytes * height);
+    const PixelType *buffer = image->GetBufferPointer();
+    for (int y = 0; y < height; y++) {
+        spc::thresholdAndPackRow(buffer + (std::size_t) y * width, width,
+                threshold, &packed[y * rowBytes]);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    argc -= (argc > 0);
+    argv += (argc > 0); // skip program name argv[0] if present
+
+    option::Stats stats(usage, argc, argv);
+    option::Option options[stats.options_max], buffer[stats.buffer_max];
+    option::Parser parse(usage, argc, argv, options, buffer);
+
+    if (parse.error()) {
+        std::cerr << "Error parsing arguments" << std::endl << std::endl;
+        return 1;
+    }
+
+    if (options[HELP]) {
+        option::printUsage(std::cout, usage);
+        return 0;
+    }
+
+    if (options[UNKNOWN].count() > 0 || parse.nonOptionsCount() > 0) {
+        std::cerr << "Unknown option(s) found " << std::endl;
+        for (option::Option* opt = options[UNKNOWN]; opt; opt = opt->next())
+            std::cerr << "\t" << opt->name << std::endl;
+        return 2;
+    }
+
+    std::vector<double> sizes;
+    std::vector<double> grids;
+    std::vector<double> hits;
+    if (!parseList(options[SIZES] ? options[SIZES].arg : "512,2048,8192",
+            sizes) ||
+        !parseList(options[GRIDS] ? options[GRIDS].arg : "5,20,100",
+            grids) ||
+        !parseList(options[HITS] ? options[HITS].arg : "0,0.5,1", hits)) {
+        std::cerr << "--sizes, --grids and --hits must be comma separated "
+                "numbers" << std::endl;
+        return 3;
+    }
+    double minSeconds = 0.2;
+    if (options[MINTIME]) {
+        minSeconds = strtod(options[MINTIME].arg, (char **) NULL);
+    }
+    std::string tmpDir = options[TMPDIR] ? options[TMPDIR].arg : "/tmp";
+    std::ostringstream os;
+    os << tmpDir << "/stereopointcounter_bench_" << getpid() << ".png";
+    std::string path = os.str();
+
+    std::cout << "Kernel,Width,Height,Grid,HitRatio,Iterations,MinMicros,"
+            "MedianMicros,MeanMicros" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    try {
+        for (std::size_t s = 0; s < sizes.size(); s++) {
+            int width = (int) sizes[s];
+            if (width < 1) {
+                std::cerr << "Skipping --sizes " << sizes[s] << std::endl;
+                continue;
+            }
+            ImageType::Pointer image = createImage(width);
+            ImageType::Pointer drawImage = spc::duplicateImage<ImageType>(
+                    image);
+            {
+                CaseTimer timer(minSeconds);
+                while (timer.more()) {
+                    timer.start();
+                    ImageType::Pointer copy = spc::duplicateImage<ImageType>(
+                            image);
+                    timer.stop();
+                }
+                timer.write("duplicateImage", width, -1, -1);
+            }
+            {
+                CaseTimer timer(minSeconds);
+                while (timer.more()) {
+                    timer.start();
+                    spc::RGBImageType::Pointer rgb =
+                            spc::castImageToRGBImage<ImageType>(image);
+                    timer.stop();
+                }
+                timer.write("castImageToRGBImage", width, -1, -1);
+            }
+            {
+                CaseTimer timer(minSeconds);
+                while (timer.more()) {
+                    timer.start();
+                    spc::writeImage<ImageType>(image, path);
+                    timer.stop();
+                }
+                timer.write("writeImage", width, -1, -1);
+            }
+            {
+                CaseTimer timer(minSeconds);
+                while (timer.more()) {
+                    timer.start();
+                    ImageType::Pointer read = spc::readImage<ImageType>(path);
+                    timer.stop();
+                }
+                timer.write("readImage", width, -1, -1);
+                unlink(path.c_str());
+            }
+            if (width > 2 * CIRCLE_RADIUS + 2) {
+                CaseTimer timer(minSeconds);
+                while (timer.more()) {
+                    timer.start();
+                    spc::drawCircle<PixelType>(drawImage, 255, width / 2,
+                            width / 2, CIRCLE_RADIUS);
+                    timer.stop();
+                }
+                timer.write("drawCircle", width, -1, -1);
+            }
+
+            std::size_t numPixels = (std::size_t) width * width;
+            std::size_t rowBytes = (width + 7) / 8;
+            std::vector<unsigned char> packed;
+            for (std::size_t h = 0; h < hits.size(); h++) {
+                int threshold = getThreshold(hits[h]);
+                {
+                    CaseTimer timer(minSeconds);
+                    while (timer.more()) {
+                        timer.start();
+                        countSink += spc::countAtOrAboveThreshold(
+                                image->GetBufferPointer(), numPixels,
+                                threshold);
+                        timer.stop();
+                    }
+                    timer.write("countAtOrAboveThreshold", width, -1,
+                            hits[h]);
+                }
+                {
+                    CaseTimer timer(minSeconds);
+                    while (timer.more()) {
+                        timer.start();
+                        packImage(image, threshold, packed);
+                        timer.stop();
+                    }
+                    countSink += packed[0];
+                    timer.write("thresholdAndPackRow", width, -1, hits[h]);
+                }
+                {
+                    CaseTimer timer(minSeconds);
+                    while (timer.more()) {
+                        timer.start();
+                        countSink += spc::popcountBytes(&packed[0],
+                                packed.size());
+                        timer.stop();
+                    }
+                    timer.write("popcountBytes", width, -1, hits[h]);
+                }
+            }
+
+            for (std::size_t g = 0; g < grids.size(); g++) {
+                int grid = (int) grids[g];
+                // getIntersectionPixelsAboveThreshold needs 1 pixel or more
+                // between grid lines, drawGridOnImage 3
+                if (grid < 1 || width / grid < 3) {
+                    std::cerr << "Skipping --grids " << grids[g]
+                            << " for --sizes " << width << std::endl;
+                    continue;
+                }
+                {
+                    CaseTimer timer(minSeconds);
+                    while (timer.more()) {
+                        timer.start();
+                        spc::drawGridOnImage<PixelType>(drawImage, 0,
+                                width / grid, width / grid);
+                        timer.stop();
+                    }
+                    timer.write("drawGridOnImage", width, grid, -1);
+                }
+                for (std::size_t h = 0; h < hits.size(); h++) {
+                    int threshold = getThreshold(hits[h]);
+                    {
+                        CaseTimer timer(minSeconds);
+                        int total;
+                        int gridWidth;
+                        int gridHeight;
+                        while (timer.more()) {
+                            timer.start();
+                            std::vector< std::pair<int, int> > points =
+                                    spc::getIntersectionPixelsAboveThreshold
+                                    <PixelType>(image, grid, grid, threshold,
+                                    total, gridWidth, gridHeight);
+                            timer.stop();
+                        }
+                        timer.write("getIntersectionPixelsAboveThreshold",
+                                width, grid, hits[h]);
+                    }
+                    {
+                        std::vector< std::pair<int, int> > points =
+                                getCirclePoints(image, grid, threshold);
+                        CaseTimer timer(minSeconds);
+                        while (timer.more()) {
+                            timer.start();
+                            spc::drawCirclesAroundPointsOnImage<PixelType>(
+                                    drawImage, 255, points, CIRCLE_RADIUS);
+                            timer.stop();
+                        }
+                        timer.write("drawCirclesAroundPointsOnImage", width,
+                                grid, hits[h]);
+                    }
+                    {
+                        // grid rows of the packed mask ANDed with the grid
+                        // columns, as maskgrid samples .spm masks
+                        int spacing = width / grid;
+                        std::vector<unsigned char> columns(rowBytes, 0);
+                        for (int x = spacing; x < width; x += spacing) {
+                            columns[x / 8] |= 0x80 >> (x % 8);
+                        }
+                        packImage(image, threshold, packed);
+                        CaseTimer timer(minSeconds);
+                        while (timer.more()) {
+                            timer.start();
+                            std::size_t positive = 0;
+                            for (int y = spacing; y < width; y += spacing) {
+                                positive += spc::popcountAnd(
+                                        &packed[y * rowBytes], &columns[0],
+                                        rowBytes);
+                            }
+                            countSink += positive;
+                            timer.stop();
+                        }
+                        timer.write("popcountAnd", width, grid, hits[h]);
+                    }
+                }
+            }
+        }
+    } catch (std::exception& e) {
+        unlink(path.c_str());
+        std::cerr << "Benchmark failed: " << spc::singleLine(e.what())
+                << std::endl;
+        return 4;
+    }
+    return EXIT_SUCCESS;
+}
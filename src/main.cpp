@@ -2,65 +2,64 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <utility>
 
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <memory>
+#include <set>
+#include <chrono>
 
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
-#include "itkTimeProbe.h"
 
 #include "optionparser.h"
+#include "OptionArg.hpp"
 #include "ImageUtils.hpp"
+#include "OverlayPolicy.hpp"
+#include "OverlayRenderer.hpp"
+#include "DeepZoomWriter.hpp"
+#include "MaskWriter.hpp"
+#include "ImageSource.hpp"
+#include "WatchImageSource.hpp"
+#include "TarImageSource.hpp"
+#include "ResultCache.hpp"
+#include "Checkpoint.hpp"
+#include "ImageProcessor.hpp"
+#include "PartialResult.hpp"
+#include "OutputBuffer.hpp"
+#include "ColumnarResults.hpp"
+#include "IntersectionValues.hpp"
+#include "Reanalysis.hpp"
+#include "PackedMask.hpp"
+#include "ImageConverter.hpp"
+#include "JsonLines.hpp"
+#include "GroupSummary.hpp"
+#include "StageStats.hpp"
 
 
-struct Arg : public option::Arg {
-
-    /**
-     * Checks that arg in option is not NULL or 0
-     * @param option option parameter to examine
-     * @param msg if true then error messages will be output to standard error
-     * @return option::ARG_OK upon success or option::ARG_ILLEGAL upon failure
-     */
-    static option::ArgStatus Required(const option::Option& option, bool msg) {
-
-        if (option.arg != 0 || option.arg != NULL) {
-            return option::ARG_OK;
-        }
-
-        if (msg) std::cerr << "Option '" << option.name << "' requires an argument" << std::endl;
-        return option::ARG_ILLEGAL;
-    }
-
-    /**
-     * Checks that arg in option is not NULL or 0 and that its a directory
-     * @param option parameter to examine
-     * @param msg if true then error messages will be output to standard error
-     * @return option::ARG_OK if option.arg exists and is a directory otherwise option::ARG_ILLEGAL
-     */
-    static option::ArgStatus RequiredDir(const option::Option& option, bool msg) {
-        if (option.arg == 0 || option.arg == NULL) {
-            return option::ARG_ILLEGAL;
-        }
-
-        struct stat st;
-        if (stat(option.arg, &st) != 0) {
-            if (msg) std::cerr << "Error running stat on directory set under option '" << option.name << "'" << std::endl;
-            return option::ARG_ILLEGAL;
-        }
-        if (!S_ISDIR(st.st_mode)) {
-            if (msg) std::cerr << "Option '" << option.name << "' must be a directory" << std::endl;
-            return option::ARG_ILLEGAL;
-        }
-        return option::ARG_OK;
-    }
+/**
+ * Set by signal handler when the run should finish up after the current
+ * image
+ */
+volatile sig_atomic_t stopRequested = 0;
 
-};
+extern "C" void requestStop(int signum) {
+    stopRequested = 1;
+}
 
-std::string usageStr = "usage: stereopointcounter [options]\n\n"
+std::string usageStr = "usage: stereopointcounter [options]\n"
+        "       stereopointcounter merge <partial file> ...\n"
+        "       stereopointcounter reanalyze -t <threshold> [--gridx <x>] "
+        "[--gridy <y>] <values file> ...\n"
+        "       stereopointcounter maskgrid --gridx <x> --gridy <y> [-r] "
+        "<mask file or directory> ...\n"
+        "       stereopointcounter convert --output <dir> [-r] "
+        "[--pattern <pattern>] <image file or directory> ...\n\n"
         "Performs automated stereology point counting on "
         "probability map images passed in via --images path. "
         "\n\nThis tool looks for *.png files and assumes they "
@@ -72,8 +71,38 @@ std::string usageStr = "usage: stereopointcounter [options]\n\n"
         "\t/../foo.png,12x8,120x80,10,,67\n"
         "\t...\n"
         "\t...\n"
-        "\tSeconds,GrandTotalPositive,GrandTotal\n"
-        "\t123,29342,234292\n\n";
+        "\tSeconds,GrandTotalPositive,GrandTotal,FailedImages\n"
+        "\t123,29342,234292,0\n\n"
+        "Images that cannot be processed are reported on standard error "
+        "as Error,<image>,<reason> and counted in FailedImages.\n\n"
+        "The merge command combines the --partial files of all --shard runs "
+        "into the output a single run would have written, with Seconds "
+        "being the sum over the shards.\n\n"
+        "The reanalyze command writes the output of a run from --savevalues "
+        "files instead of the images, for any --threshold. --gridx and "
+        "--gridy may be set to divisors of the stored grid, which then uses "
+        "every (stored/given)th stored grid line. FailedImages is left "
+        "empty as values files do not record the images that failed.\n\n"
+        "The maskgrid command writes the output of a run from .spm or .pbm "
+        "--savemasks files instead of the images, at the threshold the "
+        "masks were made with, plus the fraction of pixels set in an "
+        "AreaFraction column. Only the grid rows of .spm masks are "
+        "decoded for the counts.\n\n"
+        "The convert command rewrites images as .spr files in the --output "
+        "directory: the 8-bit greyscale pixels in LZ4 compressed blocks of "
+        "16 rows with a block index, so sampling a grid only decompresses "
+        "the blocks grid rows pass through. Images of a directory keep "
+        "their path relative to it under --output, an image whose .spr "
+        "another image already took fails. Run on them with "
+        "--pattern '*.spr'. Failures are reported like a run's and the "
+        "summary is Seconds,ConvertedImages,FailedImages.\n\n"
+        "Binary PGM (P5, maxval 255) images and raw .u8 images, rows "
+        "of 8-bit pixels described by a <file>.hdr sidecar of 'width <w>', "
+        "'height <h>' and optional 'offset <bytes>' and 'stride <bytes>' "
+        "lines, are memory mapped and sampled in place so only the pages "
+        "holding grid rows are read. Select them with --pattern '*.pgm' or "
+        "--pattern '*.u8'. They must not be truncated while being read, "
+        "that crashes the run unless --timelimit is set.\n\n";
         
 
 std::string usageWithOpts = usageStr + "Options:";
@@ -82,7 +111,12 @@ std::string usageWithOpts = usageStr + "Options:";
  * Used by optionparser to keep track of command line arguments
  */
 enum optionIndex {
-    UNKNOWN, HELP, VERSION, IMAGES, GRIDX, GRIDY, THRESHOLD, SAVEIMAGES
+    UNKNOWN, HELP, VERSION, IMAGES, GRIDX, GRIDY, THRESHOLD, SAVEIMAGES, SAVEPOLICY, PYRAMID, SAVEMASKS,
+    MASKFORMAT, RECURSIVE, PATTERN, SCANTHREADS,
+    MANIFEST, WATCH, CACHE, CACHEHASH,
+    CHECKPOINT, CHECKPOINTINTERVAL, RESUME,
+    TIMELIMIT, MAXMEMORY, SHARD, PARTIAL, FLUSHINTERVAL, OUTPUT, OUTPUTFORMAT,
+    SAVEVALUES, GROUPBY, TIMINGS
 };
 
 /**
@@ -93,23 +127,154 @@ const option::Descriptor usage[] = {
     {HELP, 0, "h", "help", option::Arg::None, "  --help, -h  \tPrint usage and exit."},
     {VERSION, 0, "v", "version", option::Arg::None,
         "  --version, -v  \tPrint version and exit."},
-    {IMAGES, 0, "i", "images", Arg::Required,
+    {IMAGES, 0, "i", "images", spc::Arg::Required,
         "  --images, -m  \tCan be set to a single greyscale 8-bit image or directory of "
-        " 8-bit greyscale *.png images"},
-    {GRIDX, 0, "", "gridx", Arg::Required,
+        " 8-bit greyscale *.png images. If set to - image paths are read one "
+        "per line from standard in as they are processed. If set to an "
+        "uncompressed tar archive the *.png members are read and decoded "
+        "straight from the archive and reported as archive.tar:member.png"},
+    {WATCH, 0, "w", "watch", option::Arg::None,
+        "  --watch, -w  \tAfter processing images in --images directory keep "
+        "running and process each new image as soon as it has been written "
+        "or moved into the directory. Running totals are written to "
+        "standard error after each image. Stop with Ctrl-C or SIGTERM to "
+        "get the summary, a second one exits without it. Also stops once "
+        "the watched directories are removed"},
+    {MANIFEST, 0, "", "manifest", spc::Arg::Required,
+        "  --manifest,  \tFile listing image paths one per line, read as "
+        "images are processed. Can be used instead of --images"},
+    {RECURSIVE, 0, "r", "recursive", option::Arg::None,
+        "  --recursive, -r  \tIf --images is a directory also look for images "
+        "in all directories below it"},
+    {PATTERN, 0, "", "pattern", spc::Arg::Required,
+        "  --pattern,  \tShell style pattern image file names in --images "
+        "directory must match. Can be repeated. Default is *.png"},
+    {SCANTHREADS, 0, "", "scanthreads", spc::Arg::Required,
+        "  --scanthreads,  \tNumber of threads used to scan directories with "
+        "--recursive. Default is 1"},
+    {GRIDX, 0, "", "gridx", spc::Arg::Required,
         "  --gridx,  \tGrid size in X.  A value of say 4 means to generate 4"
         "vertical lines evenly spaced across the image."},
-    {GRIDY, 0, "", "gridy", Arg::Required,
+    {GRIDY, 0, "", "gridy", spc::Arg::Required,
         "  --gridy,  \tGrid size in Y.  A value of say 8 means to generate 8"
         "horizontal lines evenly spaced across the image."},
-    {THRESHOLD, 0, "t", "threshold", Arg::Required,
+    {THRESHOLD, 0, "t", "threshold", spc::Arg::Required,
         "  --threshold, -t  \tThreshold to for pixel intensity that denotes"
         " a given pixel intersection is a positive hit (0 - 255)"},
-    {SAVEIMAGES, 0, "s", "saveimages", Arg::RequiredDir,
-        "  --saveimages, -s  \tIf set to <dir>, writes out images as RGB with grid "
+    {CACHE, 0, "", "cache", spc::Arg::Required,
+        "  --cache,  \tFile to keep per image results in across runs. Images "
+        "whose path, size, modification time, --gridx, --gridy and "
+        "--threshold match an entry are not decoded (unless an overlay or "
+        "mask is written). Created if it does not exist, can be shared by "
+        "concurrent runs"},
+    {CACHEHASH, 0, "", "cachehash", option::Arg::None,
+        "  --cachehash,  \tAlso require a hash of the image file contents "
+        "to match for --cache hits"},
+    {CHECKPOINT, 0, "", "checkpoint", spc::Arg::Required,
+        "  --checkpoint,  \tFile to periodically record completed images "
+        "and totals in (plus <file>.journal) so an interrupted run can be "
+        "continued with --resume"},
+    {CHECKPOINTINTERVAL, 0, "", "checkpointinterval", spc::Arg::Required,
+        "  --checkpointinterval,  \tNumber of images between --checkpoint "
+        "updates. Default is 1000"},
+    {RESUME, 0, "", "resume", option::Arg::None,
+        "  --resume,  \tContinue run recorded in --checkpoint file. Output "
+        "for images already completed is repeated from the checkpoint and "
+        "those images are skipped, so final output matches an "
+        "uninterrupted run"},
+    {TIMELIMIT, 0, "", "timelimit", spc::Arg::Required,
+        "  --timelimit,  \tProcess each image in a separate process and give "
+        "up on images that take longer than this many seconds. Also keeps "
+        "a crash while decoding one image from ending the run"},
+    {MAXMEMORY, 0, "", "maxmemory", spc::Arg::Required,
+        "  --maxmemory,  \tLimit in megabytes on memory used to hold pixels "
+        "of one image. PNG, tiled or stripped TIFF/BigTIFF and .spr images "
+        "are sampled a row, tile, strip or block at a time, reading only the "
+        "rows and tiles grid lines pass through, and PGM and .u8 images "
+        "straight from their mapping, unless --saveimages or --savemasks "
+        "needs the whole image. Tar members are held in memory whole and "
+        "also count. Images that do not fit fail. Default is no limit"},
+    {SHARD, 0, "", "shard", spc::Arg::Required,
+        "  --shard,  \tSet to i/N (0 <= i < N) to only process shard i of N "
+        "of the input list, image k of the list belongs to shard k mod N. "
+        "Not allowed with --watch"},
+    {PARTIAL, 0, "", "partial", spc::Arg::Required,
+        "  --partial,  \tFile to also write this run's rows, tagged with "
+        "their position in the input list, and totals to. The --partial "
+        "files of all shards of a run can be combined with the merge "
+        "command"},
+    {FLUSHINTERVAL, 0, "", "flushinterval", spc::Arg::Required,
+        "  --flushinterval,  \tStandard out is written in 1 MB blocks, if set "
+        "buffered rows are also written once this many seconds have passed. "
+        "Output is always written out on exit and on SIGINT or SIGTERM, "
+        "which end the run after the current image. Rows are written "
+        "immediately in --watch mode"},
+    {OUTPUT, 0, "o", "output", spc::Arg::Required,
+        "  --output, -o  \tFile to write output to instead of standard out"},
+    {OUTPUTFORMAT, 0, "", "outputformat", spc::Arg::Required,
+        "  --outputformat,  \tFormat of per image results. csv, columnar "
+        "(binary file of a path dictionary plus fixed width grid spacing, "
+        "positive and total columns that can be memory mapped with "
+        "spc::ColumnarResults, written when the run ends) or jsonl (one JSON "
+        "object per line, written as each image completes, with type image, "
+        "error or summary. Image records add size, grid spacing, bytes "
+        "read and written, --shard index as worker, source (image, cache or "
+        "checkpoint) and microseconds spent to decode, sample, render, "
+        "encode and write, streamed images are decoded and sampled together "
+        "under decode). columnar requires --output and only the summary is "
+        "written to standard out. Default is csv"},
+    {SAVEVALUES, 0, "", "savevalues", spc::Arg::Required,
+        "  --savevalues,  \tFile to write the pixel value at every grid "
+        "intersection of every image to (plus <file>.index), so other "
+        "thresholds can be counted later without reading the images. "
+        "Values of an image are stored row by row as one byte each, "
+        "intersections of a --cache hit are read from the image. Appended "
+        "to with --resume, otherwise replaced"},
+    {GROUPBY, 0, "", "groupby", spc::Arg::Required,
+        "  --groupby,  \tAlso sum results per group of images and write a "
+        "Group,Images,GroupTotalPositive,GroupTotal,CE block after the "
+        "summary (group records before the summary with --outputformat "
+        "jsonl, on standard out with columnar). depth:N groups by the first "
+        "N directories of the image path, regex:RE by the first capture "
+        "group (or whole match) of RE in the path, images RE does not match "
+        "form a group with an empty name. CE is the coefficient of error of "
+        "the group's positive/total ratio with images as sampling units, "
+        "empty with fewer than 2 images or no positive intersections"},
+    {TIMINGS, 0, "", "timings", spc::Arg::Required,
+        "  --timings,  \tFile to write the time spent in each stage to "
+        "(- for standard error) when the run ends: enumerate (finding "
+        "images), read (reading tar members), decode, sample, render "
+        "(drawing masks and overlays), encode and write. One CSV row per "
+        "stage of count, total seconds and min, mean, 50th, 90th and 99th "
+        "percentile and max microseconds, then the total bytes read and "
+        "written. Percentiles are within 12.5%"},
+    {SAVEIMAGES, 0, "s", "saveimages", spc::Arg::RequiredDir,
+        "  --saveimages, -s  \tIf set to <dir>, writes out images as 8-bit palette PNGs with grid "
         "overlayed in red and green circles denoting intersections with matches"
         " to a file with format of "
-        "grid(--gridx)x(--gridy)_pixel(pixelw)x(pixelh)_thresh(-t).(origname)"},
+        "grid(--gridx)x(--gridy)_pixel(pixelw)x(pixelh)_thresh(-t).(origname)"
+        " where origname's extension is replaced by .png"},
+    {SAVEPOLICY, 0, "", "savepolicy", spc::Arg::Required,
+        "  --savepolicy,  \tLimits which images --saveimages writes. Can be "
+        "repeated, an image is written if any policy matches. Policies: "
+        "all, every:N (every Nth image), random:F[:SEED] (fraction F of "
+        "images), zscore:Z (positive fraction more than Z standard deviations "
+        "from mean of prior images), list:FILE (paths or file names listed "
+        "one per line in FILE). Default is all"},
+    {PYRAMID, 0, "", "pyramid", option::Arg::None,
+        "  --pyramid,  \tWrite --saveimages overlays as Deep Zoom tile "
+        "pyramids of 256x256 RGB tiles (.dzi file plus _files directory) "
+        "instead of a single image"},
+    {SAVEMASKS, 0, "", "savemasks", spc::Arg::RequiredDir,
+        "  --savemasks,  \tIf set to <dir>, writes out 1-bit mask of pixels "
+        ">= --threshold for every image to a file with format of "
+        "mask_thresh(-t).(origname) where origname's extension is replaced "
+        "by that of --maskformat"},
+    {MASKFORMAT, 0, "", "maskformat", spc::Arg::Required,
+        "  --maskformat,  \tFormat of --savemasks files. png (1-bit PNG, "
+        "set pixels white), pbm (binary packed PBM, set pixels black) or spm "
+        "(packed bits with PackBits compressed rows and a row index, read "
+        "by the maskgrid command). Default is png"},
     {0, 0, 0, 0, 0, 0}
 };
 
@@ -117,6 +282,178 @@ int main(int argc, char *argv[]) {
     argc -= (argc > 0);
     argv += (argc > 0); // skip program name argv[0] if present
 
+    if (argc > 0 && std::string(argv[0]) == "merge"){
+        if (argc < 2){
+            std::cerr << "merge requires at least one --partial file"
+                    << std::endl;
+            return 1;
+        }
+        std::vector<std::string> partials(argv + 1, argv + argc);
+        std::string mergeError;
+        if (!spc::mergePartialResults(partials,std::cout,mergeError)){
+            std::cerr << "Unable to merge: " << mergeError << std::endl;
+            return 22;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 0 && std::string(argv[0]) == "reanalyze"){
+        option::Stats stats(true, usage, argc - 1, argv + 1);
+        option::Option options[stats.options_max], buffer[stats.buffer_max];
+        option::Parser parse(true, usage, argc - 1, argv + 1, options, buffer);
+        for (int i = 0; i < parse.optionsCount(); i++){
+            int index = buffer[i].index();
+            if (index != THRESHOLD && index != GRIDX && index != GRIDY){
+                std::cerr << "reanalyze only takes --threshold, --gridx and "
+                        "--gridy, not " << buffer[i].name << std::endl;
+                return 1;
+            }
+        }
+        if (parse.error() || options[THRESHOLD].arg == NULL ||
+            parse.nonOptionsCount() == 0){
+            std::cerr << "reanalyze requires --threshold and at least one "
+                    "--savevalues file" << std::endl;
+            return 1;
+        }
+        int threshold = std::strtol(options[THRESHOLD].arg, (char **) NULL,
+                10);
+        int gridX = options[GRIDX].arg == NULL ? 0 :
+                std::strtol(options[GRIDX].arg, (char **) NULL, 10);
+        int gridY = options[GRIDY].arg == NULL ? 0 :
+                std::strtol(options[GRIDY].arg, (char **) NULL, 10);
+        if (gridX < 0 || gridY < 0){
+            std::cerr << "--gridx and --gridy must be greater than 0"
+                    << std::endl;
+            return 1;
+        }
+        std::vector<std::string> valueFiles(parse.nonOptions(),
+                parse.nonOptions() + parse.nonOptionsCount());
+        spc::OutputBuffer out(STDOUT_FILENO);
+        std::string reanalyzeError;
+        if (!spc::reanalyzeIntersectionValues(valueFiles,threshold,gridX,
+                gridY,out,reanalyzeError)){
+            std::cerr << "Unable to reanalyze: " << reanalyzeError
+                    << std::endl;
+            return 27;
+        }
+        if (!out.flush()){
+            std::cerr << "Error writing output" << std::endl;
+            return 23;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 0 && std::string(argv[0]) == "maskgrid"){
+        option::Stats stats(true, usage, argc - 1, argv + 1);
+        option::Option options[stats.options_max], buffer[stats.buffer_max];
+        option::Parser parse(true, usage, argc - 1, argv + 1, options, buffer);
+        for (int i = 0; i < parse.optionsCount(); i++){
+            int index = buffer[i].index();
+            if (index != GRIDX && index != GRIDY && index != RECURSIVE){
+                std::cerr << "maskgrid only takes --gridx, --gridy and "
+                        "--recursive, not " << buffer[i].name << std::endl;
+                return 1;
+            }
+        }
+        if (parse.error() || options[GRIDX].arg == NULL ||
+            options[GRIDY].arg == NULL || parse.nonOptionsCount() == 0){
+            std::cerr << "maskgrid requires --gridx, --gridy and at least "
+                    "one mask file or directory" << std::endl;
+            return 1;
+        }
+        spc::ScanOptions maskScan;
+        maskScan.recursive = options[RECURSIVE];
+        maskScan.patterns.clear();
+        maskScan.patterns.push_back("*.spm");
+        maskScan.patterns.push_back("*.pbm");
+        std::vector<std::string> masks;
+        for (int i = 0; i < parse.nonOptionsCount(); i++){
+            std::vector<std::string> found = spc::getImages(
+                    parse.nonOption(i),maskScan);
+            masks.insert(masks.end(),found.begin(),found.end());
+        }
+        spc::OutputBuffer out(STDOUT_FILENO);
+        spc::sampleMaskGrids(masks,
+                std::strtol(options[GRIDX].arg, (char **) NULL, 10),
+                std::strtol(options[GRIDY].arg, (char **) NULL, 10),
+                out,std::cerr);
+        if (!out.flush()){
+            std::cerr << "Error writing output" << std::endl;
+            return 23;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 0 && std::string(argv[0]) == "convert"){
+        option::Stats stats(true, usage, argc - 1, argv + 1);
+        option::Option options[stats.options_max], buffer[stats.buffer_max];
+        option::Parser parse(true, usage, argc - 1, argv + 1, options, buffer);
+        for (int i = 0; i < parse.optionsCount(); i++){
+            int index = buffer[i].index();
+            if (index != OUTPUT && index != RECURSIVE && index != PATTERN){
+                std::cerr << "convert only takes --output, --recursive and "
+                        "--pattern, not " << buffer[i].name << std::endl;
+                return 1;
+            }
+        }
+        if (parse.error() || options[OUTPUT].arg == NULL ||
+            parse.nonOptionsCount() == 0){
+            std::cerr << "convert requires --output and at least one image "
+                    "file or directory" << std::endl;
+            return 1;
+        }
+        struct stat st;
+        if (stat(options[OUTPUT].arg, &st) != 0 || !S_ISDIR(st.st_mode)){
+            std::cerr << "--output must be a directory" << std::endl;
+            return 1;
+        }
+        std::chrono::steady_clock::time_point convertStart =
+                std::chrono::steady_clock::now();
+        spc::ScanOptions convertScan;
+        convertScan.recursive = options[RECURSIVE];
+        if (options[PATTERN]){
+            convertScan.patterns.clear();
+            for (option::Option* opt = options[PATTERN]; opt; opt = opt->next()){
+                convertScan.patterns.push_back(opt->arg);
+            }
+        }
+        long converted = 0;
+        long failed = 0;
+        // images of different directories or extensions can map to the
+        // same output, the first one wins
+        std::set<std::string> outputs;
+        for (int i = 0; i < parse.nonOptionsCount(); i++){
+            std::vector<std::string> images = spc::getImages(
+                    parse.nonOption(i),convertScan);
+            for (std::size_t j = 0; j < images.size(); j++){
+                std::string output = spc::getConvertedPath(images[j],
+                        parse.nonOption(i),options[OUTPUT].arg);
+                if (!outputs.insert(output).second){
+                    std::cerr << "Error," << images[j] << ",Output " << output
+                            << " already written for another image"
+                            << std::endl;
+                    failed++;
+                    continue;
+                }
+                try {
+                    spc::makeParentDirectories(output,options[OUTPUT].arg);
+                    spc::convertToRowBlocks(images[j],output);
+                    converted++;
+                } catch (itk::ExceptionObject & err) {
+                    std::cerr << "Error," << images[j] << ","
+                            << err.GetDescription() << std::endl;
+                    failed++;
+                }
+            }
+        }
+        std::chrono::duration<double> convertTime =
+                std::chrono::steady_clock::now() - convertStart;
+        std::cout << "Seconds,ConvertedImages,FailedImages" << std::endl
+                << convertTime.count() << "," << converted << "," << failed
+                << std::endl;
+        return EXIT_SUCCESS;
+    }
+
     if (argc < 2) {
         std::cerr << "Invalid arguments" << std::endl << std::endl;
         option::Stats stats(usage, argc, argv);
@@ -167,8 +504,8 @@ int main(int argc, char *argv[]) {
         return 5;
 
     }
-    if (options[IMAGES].arg == NULL) {
-        std::cerr << "--images required.  Run with --help for more information"
+    if (options[IMAGES].arg == NULL && options[MANIFEST].arg == NULL) {
+        std::cerr << "--images or --manifest required.  Run with --help for more information"
                 << std::endl;
         return 6;
     }
@@ -181,77 +518,513 @@ int main(int argc, char *argv[]) {
     if (options[SAVEIMAGES].arg != NULL){
         save_images_dir = std::string(options[SAVEIMAGES].arg);
     }
-    itk::TimeProbe clock;
-    clock.Start();
-
+    std::string save_masks_dir = "";
+    if (options[SAVEMASKS].arg != NULL){
+        save_masks_dir = std::string(options[SAVEMASKS].arg);
+    }
+    spc::MaskFormat maskFormat = spc::MASK_PNG;
+    if (options[MASKFORMAT].arg != NULL &&
+        !spc::parseMaskFormat(options[MASKFORMAT].arg,maskFormat)){
+        std::cerr << "Invalid --maskformat " << options[MASKFORMAT].arg
+                << ".  Run with --help for more information" << std::endl;
+        return 10;
+    }
+    spc::OverlayPolicy overlayPolicy;
+    for (option::Option* opt = options[SAVEPOLICY]; opt; opt = opt->next()) {
+        std::string policyError;
+        if (!overlayPolicy.addRule(std::string(opt->arg), policyError)) {
+            std::cerr << "Invalid --savepolicy " << opt->arg << ": "
+                    << policyError << std::endl;
+            return 8;
+        }
+    }
+    if (options[SAVEPOLICY] && save_images_dir.length() == 0) {
+        std::cerr << "--savepolicy requires --saveimages.  Run with --help "
+                "for more information" << std::endl;
+        return 9;
+    }
+    spc::ResultCache resultCache;
+    bool useCache = options[CACHE].arg != NULL;
+    if (useCache){
+        std::string cacheError;
+        if (!resultCache.open(options[CACHE].arg,options[CACHEHASH],
+                cacheError)){
+            std::cerr << "Unable to open --cache " << options[CACHE].arg
+                    << ": " << cacheError << std::endl;
+            return 14;
+        }
+    }
     int gridX = std::strtol(options[GRIDX].arg, (char **) NULL, 10);
     int gridY = std::strtol(options[GRIDY].arg, (char **) NULL, 10);
     int threshold = std::strtol(options[THRESHOLD].arg, (char **) NULL, 10);
 
-    std::vector<std::string> images = spc::getImages(std::string(options[IMAGES].arg));
+    double timeLimit = 0.0;
+    if (options[TIMELIMIT].arg != NULL){
+        timeLimit = std::strtod(options[TIMELIMIT].arg, (char **) NULL);
+        if (timeLimit <= 0.0){
+            std::cerr << "--timelimit must be greater than 0" << std::endl;
+            return 17;
+        }
+    }
+    std::size_t maxMemory = 0;
+    if (options[MAXMEMORY].arg != NULL){
+        long maxMemoryMB = std::strtol(options[MAXMEMORY].arg,
+                (char **) NULL, 10);
+        if (maxMemoryMB <= 0){
+            std::cerr << "--maxmemory must be greater than 0" << std::endl;
+            return 19;
+        }
+        maxMemory = (std::size_t) maxMemoryMB << 20;
+    }
+    int shardIndex = 0;
+    int shardCount = 1;
+    if (options[SHARD].arg != NULL){
+        if (!spc::parseShard(options[SHARD].arg,shardIndex,shardCount)){
+            std::cerr << "Invalid --shard " << options[SHARD].arg
+                    << ", must be i/N with 0 <= i < N" << std::endl;
+            return 20;
+        }
+        if (options[WATCH]){
+            std::cerr << "--shard cannot be used with --watch" << std::endl;
+            return 20;
+        }
+    }
+    spc::PartialResultWriter partial;
+    bool usePartial = options[PARTIAL].arg != NULL;
+    if (usePartial){
+        std::string partialError;
+        if (!partial.open(options[PARTIAL].arg,shardIndex,shardCount,gridX,
+                gridY,threshold,partialError)){
+            std::cerr << "Unable to open --partial " << options[PARTIAL].arg
+                    << ": " << partialError << std::endl;
+            return 21;
+        }
+    }
+    bool columnar = false;
+    bool jsonl = false;
+    if (options[OUTPUTFORMAT].arg != NULL){
+        std::string format(options[OUTPUTFORMAT].arg);
+        columnar = format == "columnar";
+        jsonl = format == "jsonl";
+        if (!columnar && !jsonl && format != "csv"){
+            std::cerr << "Invalid --outputformat " << format
+                    << ".  Run with --help for more information" << std::endl;
+            return 24;
+        }
+    }
+    if (columnar && options[OUTPUT].arg == NULL){
+        std::cerr << "--outputformat columnar requires --output" << std::endl;
+        return 24;
+    }
+    int outputFd = STDOUT_FILENO;
+    spc::ColumnarResultWriter columnarOut;
+    if (options[OUTPUT].arg != NULL){
+        std::string outputError;
+        if (columnar){
+            columnarOut.open(options[OUTPUT].arg,gridX,gridY,threshold,
+                    outputError);
+        }
+        else {
+            outputFd = open(options[OUTPUT].arg,
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+            if (outputFd < 0){
+                outputError = strerror(errno);
+            }
+        }
+        if (!outputError.empty()){
+            std::cerr << "Unable to open --output " << options[OUTPUT].arg
+                    << ": " << outputError << std::endl;
+            return 25;
+        }
+    }
+    spc::Checkpoint checkpoint;
+    bool useCheckpoint = options[CHECKPOINT].arg != NULL;
+    if (options[RESUME] && !useCheckpoint){
+        std::cerr << "--resume requires --checkpoint.  Run with --help "
+                "for more information" << std::endl;
+        return 15;
+    }
+    if (useCheckpoint){
+        int interval = 1000;
+        if (options[CHECKPOINTINTERVAL].arg != NULL){
+            interval = std::strtol(options[CHECKPOINTINTERVAL].arg,
+                    (char **) NULL, 10);
+        }
+        std::string checkpointError;
+        if (!checkpoint.open(options[CHECKPOINT].arg,gridX,gridY,threshold,
+                interval,options[RESUME],checkpointError)){
+            std::cerr << "Unable to open --checkpoint: " << checkpointError
+                    << std::endl;
+            return 16;
+        }
+    }
+    spc::GroupSummary groups;
+    if (options[GROUPBY].arg != NULL){
+        std::string groupError;
+        if (!groups.setSpec(options[GROUPBY].arg,groupError)){
+            std::cerr << "Invalid --groupby " << options[GROUPBY].arg
+                    << ": " << groupError << std::endl;
+            return 28;
+        }
+    }
+    spc::IntersectionValueWriter valueWriter;
+    bool saveValues = options[SAVEVALUES].arg != NULL;
+    if (saveValues){
+        std::string valuesError;
+        if (!valueWriter.open(options[SAVEVALUES].arg,options[RESUME],
+                valuesError)){
+            std::cerr << "Unable to open --savevalues "
+                    << options[SAVEVALUES].arg << ": " << valuesError
+                    << std::endl;
+            return 26;
+        }
+    }
+    int timingsFd = -1;
+    if (options[TIMINGS].arg != NULL){
+        if (std::string(options[TIMINGS].arg) == "-"){
+            timingsFd = STDERR_FILENO;
+        }
+        else {
+            timingsFd = open(options[TIMINGS].arg,
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+            if (timingsFd < 0){
+                std::cerr << "Unable to open --timings "
+                        << options[TIMINGS].arg << ": " << strerror(errno)
+                        << std::endl;
+                return 29;
+            }
+        }
+    }
+    spc::StageStats stageStats;
+    std::chrono::steady_clock::time_point startTime =
+            std::chrono::steady_clock::now();
+
+    spc::ScanOptions scanOptions;
+    scanOptions.recursive = options[RECURSIVE];
+    if (options[PATTERN]){
+        scanOptions.patterns.clear();
+        for (option::Option* opt = options[PATTERN]; opt; opt = opt->next()) {
+            scanOptions.patterns.push_back(opt->arg);
+        }
+    }
+    if (options[SCANTHREADS].arg != NULL){
+        scanOptions.numThreads = std::strtol(options[SCANTHREADS].arg,
+                (char **) NULL, 10);
+    }
+    // stop after the current image so buffered output and the summary are
+    // written, a second signal terminates right away.  Waits for --images
+    // -, --manifest and --watch input end on the signal
+    struct sigaction action;
+    memset(&action,0,sizeof(action));
+    action.sa_handler = requestStop;
+    action.sa_flags = SA_RESTART | SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT,&action,NULL);
+    sigaction(SIGTERM,&action,NULL);
+
+    std::chrono::steady_clock::time_point stageStart =
+            std::chrono::steady_clock::now();
+    std::unique_ptr<spc::ImageSource> images;
+    spc::TarImageSource *tarImages = NULL;
+    if (options[MANIFEST].arg != NULL){
+        spc::StreamImageSource *manifest = new spc::StreamImageSource(
+                std::string(options[MANIFEST].arg),&stopRequested);
+        images.reset(manifest);
+        if (!manifest->isOpen()){
+            std::cerr << "Unable to open --manifest " << options[MANIFEST].arg
+                    << std::endl;
+            return 11;
+        }
+    }
+    else if (options[WATCH]){
+        if (!spc::is_dir(options[IMAGES].arg)){
+            std::cerr << "--watch requires --images to be a directory"
+                    << std::endl;
+            return 12;
+        }
+        spc::WatchImageSource *watch = new spc::WatchImageSource(
+                std::string(options[IMAGES].arg),scanOptions,&stopRequested);
+        images.reset(watch);
+        if (!watch->isOpen()){
+            std::cerr << "Unable to watch " << options[IMAGES].arg
+                    << std::endl;
+            return 13;
+        }
+    }
+    else if (std::string(options[IMAGES].arg) == "-"){
+        images.reset(new spc::StreamImageSource(STDIN_FILENO,
+                &stopRequested));
+    }
+    else if (spc::isTarArchive(options[IMAGES].arg)){
+        tarImages = new spc::TarImageSource(std::string(options[IMAGES].arg),
+                scanOptions,maxMemory);
+        images.reset(tarImages);
+        if (!tarImages->isOpen()){
+            std::cerr << "Unable to open --images " << options[IMAGES].arg
+                    << ": " << tarImages->getError() << std::endl;
+            return 18;
+        }
+    }
+    else {
+        images.reset(new spc::ListImageSource(spc::getImages(
+                std::string(options[IMAGES].arg),scanOptions)));
+    }
     
-    int totalPCount = 0;
-    int totalNCount = 0;
+    stageStats.add(spc::StageStats::ENUMERATE,spc::microsSince(stageStart));
+
+    spc::ProcessorSettings settings;
+    settings.gridX = gridX;
+    settings.gridY = gridY;
+    settings.threshold = threshold;
+    settings.saveImagesDir = save_images_dir;
+    settings.pyramid = options[PYRAMID];
+    settings.saveMasksDir = save_masks_dir;
+    settings.maskFormat = maskFormat;
+    settings.maxMemory = maxMemory;
+    spc::ImageProcessor processor(settings,&overlayPolicy);
+
+    long long totalPCount = 0;
+    long long totalNCount = 0;
+    int failedCount = 0;
     std::string curImage;
-    typedef unsigned char PixelType;
-    typedef itk::Image<PixelType, 2> ImageType;
-    ImageType::Pointer image;
-    spc::RGBPixelType greenPixel;
-    greenPixel.SetRed(0);
-    greenPixel.SetBlue(0);
-    greenPixel.SetGreen(255);
-    spc::RGBPixelType redPixel;
-    redPixel.SetRed(255);
-    redPixel.SetBlue(0);
-    redPixel.SetGreen(0);
-    int image_total = 0;
-    int imagePCount = 0;
-    int imageNCount = 0;
-    int grid_width = 0;
-    int grid_height = 0;
+    std::string errorMsg;
+    spc::ImageResult result;
+    spc::IntersectionValues values;
+    spc::IntersectionValues *valuesOut = saveValues ? &values : NULL;
     
-    std::vector< std::pair<int,int> > positivePixels;
-    std::cout << "Image,GridSize,GridSizePixel,Positive,Total" << std::endl;
-    for (std::vector<std::string>::iterator it = images.begin(); it != images.end(); ++it) {
-        
-        curImage = *it;
-        image = spc::readImage<ImageType>(curImage);
-        
-        positivePixels = spc::getIntersectionPixelsAboveThreshold<PixelType>(image,gridX,
-                gridY,threshold,image_total,grid_width,grid_height);
-    
-        imagePCount = positivePixels.size();
-        imageNCount = image_total - imagePCount;
-        
-        std::cout <<*it<<","<<gridX<<"x"<<gridY<<","<<grid_width<<"x"
-                <<grid_height<<","<<imagePCount<<","
-                  <<image_total<<std::endl;
-        totalPCount += imagePCount;
-        totalNCount += imageNCount;
+    double flushInterval = 0.0;
+    if (options[FLUSHINTERVAL].arg != NULL){
+        flushInterval = std::strtod(options[FLUSHINTERVAL].arg,
+                (char **) NULL);
+    }
+    spc::OutputBuffer out(outputFd,1 << 20,flushInterval);
+    spc::LineBuilder line;
+    spc::LineBuilder record;
+    bool outputOk = true;
+    if (!columnar && !jsonl){
+        out.write("Image,GridSize,GridSizePixel,Positive,Total\n");
+    }
+    const std::vector<spc::CheckpointRow> &completedRows =
+            checkpoint.getCompletedRows();
+    for (std::size_t i = 0; i < completedRows.size(); i++){
+        const spc::CheckpointRow &row = completedRows[i];
+        if (columnar){
+            outputOk = columnarOut.add(row.path,row.gridWidth,
+                    row.gridHeight,row.positive,row.total) && outputOk;
+        }
+        else if (jsonl){
+            spc::ImageResult resumed = spc::ImageResult();
+            resumed.gridWidth = row.gridWidth;
+            resumed.gridHeight = row.gridHeight;
+            resumed.positive = row.positive;
+            resumed.total = row.total;
+            record.clear();
+            spc::appendImageRecord(record,row.path,"checkpoint",shardIndex,
+                    gridX,gridY,resumed);
+            out.writeLine(record);
+        }
+        else {
+            line.clear();
+            out.writeLine(line.append(row.csv));
+        }
+        totalPCount += row.positive;
+        totalNCount += row.total - row.positive;
+        groups.add(row.path,row.positive,row.total);
         if (save_images_dir.length() > 0){
-            std::ostringstream os;
-            
-            ImageType::Pointer imageCopy = spc::duplicateImage<ImageType>(image);
-            spc::RGBImageType::Pointer rgbimage = spc::castImageToRGBImage
-                    <ImageType>(imageCopy);
-            rgbimage = spc::drawGridOnImage<spc::RGBPixelType>(rgbimage,
-                    redPixel,grid_width,grid_height);
-            rgbimage = spc::drawCirclesAroundPointsOnImage
-                    <spc::RGBPixelType>(rgbimage,greenPixel,positivePixels,5);
-            
-            os << save_images_dir << "/grid" << gridX << "x" << gridY << "_pixel"
-                    << grid_width <<"x"<< grid_height
-                    << "_thresh" << threshold << "." 
-                    << spc::getFileNameFromPath(curImage);
-            
-            spc::writeImage<spc::RGBImageType>(rgbimage,os.str());
-        }
-        positivePixels.clear();
-    }
-    clock.Stop();    
-    std::cout <<std::endl<<"Seconds,GrandTotalPositive,GrandTotal"<<std::endl;
-    std::cout << clock.GetTotal() << ","<< totalPCount << "," 
-            << (totalPCount + totalNCount)<< std::endl;
-    
+            // keep running statistics and counters of policy in step
+            overlayPolicy.select(row.path,row.positive,row.total);
+        }
+    }
+    long imageIndex = -1;
+    while (!stopRequested) {
+        stageStart = std::chrono::steady_clock::now();
+        // images of other shards are stepped over without loading them
+        bool inShard = (imageIndex + 1) % shardCount == shardIndex;
+        if (!(inShard ? images->next(curImage) :
+                images->skipNext(curImage))){
+            break;
+        }
+        // sources that hand over the image's bytes read them in next()
+        stageStats.add(images->getData() == NULL ?
+                spc::StageStats::ENUMERATE : spc::StageStats::READ,
+                spc::microsSince(stageStart));
+        imageIndex++;
+        if (!inShard){
+            continue;
+        }
+        if (useCheckpoint && checkpoint.isCompleted(curImage)){
+            if (usePartial){
+                const spc::CheckpointRow *row =
+                        checkpoint.getCompleted(curImage);
+                partial.addRow(imageIndex,row->positive,row->total,row->csv);
+            }
+            continue;
+        }
+        // archive members have no file of their own to key the cache on
+        const std::vector<unsigned char> *data = images->getData();
+        bool cacheable = useCache && data == NULL;
+        spc::CachedResult cached;
+        bool cacheHit = cacheable &&
+                resultCache.lookup(curImage,gridX,gridY,threshold,cached);
+        bool ok;
+        if (tarImages != NULL && !tarImages->getMemberError().empty()){
+            // member too large to hold, its data was skipped
+            ok = false;
+            errorMsg = tarImages->getMemberError();
+        }
+        else if (timeLimit > 0){
+            ok = spc::processImageInChild(processor,curImage,data,
+                    cacheHit ? &cached : NULL,timeLimit,&overlayPolicy,
+                    result,errorMsg,valuesOut);
+        }
+        else {
+            ok = spc::processImage(processor,curImage,data,
+                    cacheHit ? &cached : NULL,result,errorMsg,valuesOut);
+        }
+        if (!ok){
+            failedCount++;
+            std::cerr << "Error," << curImage << "," << errorMsg << std::endl;
+            if (jsonl){
+                record.clear();
+                spc::appendErrorRecord(record,curImage,shardIndex,errorMsg);
+                out.writeLine(record);
+                out.flush();
+            }
+            continue;
+        }
+        stageStats.add(result);
+        if (cacheable && !cacheHit){
+            cached.gridWidth = result.gridWidth;
+            cached.gridHeight = result.gridHeight;
+            cached.positive = result.positive;
+            cached.total = result.total;
+            if (!resultCache.store(curImage,gridX,gridY,threshold,cached)){
+                std::cerr << "Unable to add " << curImage
+                        << " to --cache" << std::endl;
+            }
+        }
+        
+        line.clear();
+        line.append(curImage).append(',').append(gridX).append('x')
+                .append(gridY).append(',').append(result.gridWidth)
+                .append('x').append(result.gridHeight).append(',')
+                .append(result.positive).append(',').append(result.total);
+        if (columnar){
+            outputOk = columnarOut.add(curImage,result.gridWidth,
+                    result.gridHeight,result.positive,result.total) &&
+                    outputOk;
+        }
+        else if (jsonl){
+            // streamed as each image completes so the file can be tailed
+            record.clear();
+            spc::appendImageRecord(record,curImage,cacheHit ? "cache" :
+                    "image",shardIndex,gridX,gridY,result);
+            out.writeLine(record);
+            out.flush();
+        }
+        else {
+            out.writeLine(line);
+        }
+        totalPCount += result.positive;
+        totalNCount += result.total - result.positive;
+        groups.add(curImage,result.positive,result.total);
+        if (saveValues && !valueWriter.add(curImage,gridX,gridY,
+                result.gridWidth,result.gridHeight,values)){
+            std::cerr << "Error writing --savevalues" << std::endl;
+        }
+        if (usePartial && !partial.addRow(imageIndex,result.positive,
+                result.total,line.str())){
+            std::cerr << "Error writing --partial" << std::endl;
+        }
+        if (options[WATCH]){
+            out.flush();
+            std::cerr << "RunningTotal," << totalPCount << ","
+                    << (totalPCount + totalNCount) << std::endl;
+        }
+        if (useCheckpoint){
+            std::chrono::duration<double> elapsed =
+                    std::chrono::steady_clock::now() - startTime;
+            if (!checkpoint.add(line.str(),result.positive,result.total,
+                    elapsed.count())){
+                std::cerr << "Error writing --checkpoint" << std::endl;
+            }
+        }
+    }
+    if (tarImages != NULL && !tarImages->getError().empty() &&
+            shardIndex == 0){
+        // rest of archive is unreadable, count it as one failure.  Every
+        // shard steps through the archive and runs into it, only shard 0
+        // reports it so merge counts it once
+        failedCount++;
+        std::cerr << "Error," << options[IMAGES].arg << ","
+                << tarImages->getError() << std::endl;
+        if (jsonl){
+            record.clear();
+            spc::appendErrorRecord(record,options[IMAGES].arg,shardIndex,
+                    tarImages->getError());
+            out.writeLine(record);
+        }
+    }
+    std::chrono::duration<double> runTime =
+            std::chrono::steady_clock::now() - startTime;
+    double seconds = runTime.count();
+    if (useCheckpoint){
+        if (!checkpoint.commit(seconds)){
+            std::cerr << "Error writing --checkpoint" << std::endl;
+        }
+        seconds += checkpoint.getPreviousSeconds();
+    }
+    if (saveValues && !valueWriter.close()){
+        std::cerr << "Error writing --savevalues" << std::endl;
+    }
+    // a partial result without summary marks a shard that did not finish
+    bool finished = !stopRequested || options[WATCH];
+    if (usePartial && finished && !partial.close(seconds,failedCount)){
+        std::cerr << "Error writing --partial" << std::endl;
+    }
+    if (columnar){
+        outputOk = columnarOut.close(seconds,failedCount) && outputOk;
+    }
+    // summary of a columnar run goes to standard out, it is also in the
+    // file's header
+    spc::OutputBuffer summaryOut(STDOUT_FILENO);
+    spc::OutputBuffer &summary = columnar ? summaryOut : out;
+    line.clear();
+    if (jsonl){
+        if (groups.isEnabled()){
+            groups.writeJsonLines(summary);
+        }
+        spc::appendSummaryRecord(line,seconds,totalPCount,
+                totalPCount + totalNCount,failedCount);
+    }
+    else {
+        summary.write(columnar ? "Seconds,GrandTotalPositive,GrandTotal,"
+                "FailedImages\n" : "\nSeconds,GrandTotalPositive,GrandTotal,"
+                "FailedImages\n");
+        line.append(seconds).append(',').append(totalPCount).append(',')
+                .append(totalPCount + totalNCount).append(',')
+                .append(failedCount);
+    }
+    summary.writeLine(line);
+    if (!jsonl && groups.isEnabled()){
+        groups.writeCsv(summary);
+    }
+    outputOk = out.flush() && summary.flush() && outputOk;
+    if (outputFd != STDOUT_FILENO){
+        outputOk = close(outputFd) == 0 && outputOk;
+    }
+    if (timingsFd >= 0){
+        spc::OutputBuffer timingsOut(timingsFd);
+        stageStats.writeCsv(timingsOut);
+        if (!timingsOut.flush() || (timingsFd != STDERR_FILENO &&
+                close(timingsFd) != 0)){
+            std::cerr << "Error writing --timings" << std::endl;
+        }
+    }
+    if (!outputOk){
+        std::cerr << "Error writing output" << std::endl;
+        return 23;
+    }
+
     return EXIT_SUCCESS;
 }